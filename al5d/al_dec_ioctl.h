@@ -55,6 +55,15 @@ struct al5_decode_msg {
 	__u32 slice_param_v;
 };
 
+#define AL5_DECODE_RECORD_FRAME 0
+#define AL5_DECODE_RECORD_SLICE 1
+
+/* record of the submission ring */
+struct al5_decode_record {
+	__u32 type;
+	struct al5_decode_msg msg;
+};
+
 struct al5_search_sc_msg {
 	struct al5_params param;
 	struct al5_params buffer_addrs;
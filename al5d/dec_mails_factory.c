@@ -57,6 +57,9 @@ al5d_create_decode_one_slice_msg(u32 chan_uid, struct al5_decode_msg *msg)
 	struct al5_mail *mail = al5_mail_create(AL_MCU_MSG_DECODE_ONE_SLICE,
 						mail_size);
 
+	if (!mail)
+		return NULL;
+
 	write_decode_mail(mail, chan_uid, msg);
 
 	return mail;
@@ -70,6 +73,9 @@ al5d_create_decode_one_frame_msg(u32 chan_uid, struct al5_decode_msg *msg)
 	struct al5_mail *mail = al5_mail_create(AL_MCU_MSG_DECODE_ONE_FRM,
 						mail_size);
 
+	if (!mail)
+		return NULL;
+
 	write_decode_mail(mail, chan_uid, msg);
 
 	return mail;
@@ -19,6 +19,7 @@
 
 #include <linux/printk.h>
 #include <linux/string.h>
+#include <linux/err.h>
 
 #include "dec_user.h"
 #include "dec_mails_factory.h"
@@ -73,9 +74,7 @@ int al5d_user_create_channel(struct al5_user *user,
 	if (err)
 		goto unlock;
 
-	err =
-		al5_queue_pop_timeout(&feedback,
-				      &user->queues[AL5_USER_MAIL_CREATE]);
+	err = al5_user_pop_answer(user, AL5_USER_MAIL_CREATE, &feedback);
 	if (err)
 		goto unlock;
 
@@ -148,6 +147,41 @@ unlock:
 }
 EXPORT_SYMBOL_GPL(al5d_user_decode_one_frame);
 
+static struct al5_mail *decode_record_to_mail(struct al5_user *user,
+					      void *record)
+{
+	struct al5_decode_record *rec = record;
+	struct al5_decode_msg *msg = &rec->msg;
+
+	if (msg->params.size > sizeof(msg->params.opaque) ||
+	    msg->addresses.size > sizeof(msg->addresses.opaque))
+		return ERR_PTR(-EINVAL);
+
+	switch (rec->type) {
+	case AL5_DECODE_RECORD_FRAME:
+		return al5d_create_decode_one_frame_msg(user->chan_uid, msg);
+	case AL5_DECODE_RECORD_SLICE:
+		return al5d_create_decode_one_slice_msg(user->chan_uid, msg);
+	default:
+		return ERR_PTR(-EINVAL);
+	}
+}
+
+int al5d_user_setup_submit_ring(struct al5_user *user,
+				struct al5_ring_info *info)
+{
+	return al5_user_setup_submit_ring(user, info,
+					  sizeof(struct al5_decode_record));
+}
+EXPORT_SYMBOL_GPL(al5d_user_setup_submit_ring);
+
+/* Decode the frames and slices written in the submission ring */
+int al5d_user_submit_ring_doorbell(struct al5_user *user)
+{
+	return al5_user_drain_submit_ring(user, decode_record_to_mail);
+}
+EXPORT_SYMBOL_GPL(al5d_user_submit_ring_doorbell);
+
 int al5d_user_search_start_code(struct al5_user *user,
 				struct al5_search_sc_msg *msg)
 {
@@ -161,6 +195,10 @@ int al5d_user_wait_for_status(struct al5_user *user, struct al5_params *msg)
 	struct al5_mail *feedback;
 	int err = 0;
 
+	/* statuses only go to the ring once it is set up */
+	if (user->status_ring)
+		return -EBUSY;
+
 	if (!mutex_trylock(&user->locks[AL5_USER_STATUS]))
 		return -EINTR;
 
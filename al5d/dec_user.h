@@ -31,3 +31,6 @@ int al5d_user_wait_for_start_code(struct al5_user *user,
 				  struct al5_scstatus *msg);
 int al5d_user_decode_one_slice(struct al5_user *user,
 			       struct al5_decode_msg *msg);
+int al5d_user_setup_submit_ring(struct al5_user *user,
+				struct al5_ring_info *info);
+int al5d_user_submit_ring_doorbell(struct al5_user *user);
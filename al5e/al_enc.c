@@ -81,18 +81,22 @@ static int ioctl_usage(struct al5_user *user, unsigned int cmd)
 	       (unsigned long)AL_MCU_WAIT_FOR_STATUS);
 	pr_err("GET_DMA_FD:%.8lX\n",
 	       (unsigned long)GET_DMA_FD);
+	pr_err("GET_DMA_FD_EXT:%.8lX\n",
+	       (unsigned long)GET_DMA_FD_EXT);
 
 	return -EINVAL;
 }
 
-static long al5e_ioctl(struct file *filp, unsigned int cmd,
-		       unsigned long arg)
+static long handle_ioctl(struct file *filp, unsigned int cmd,
+			 unsigned long arg)
 {
 	struct al5_filp_data *filp_data = filp->private_data;
 	struct al5_user *user = filp_data->user;
 	struct al5_codec_desc *codec = filp_data->codec;
 	long ret;
 
+	user->nonblock = filp->f_flags & O_NONBLOCK;
+
 	switch (cmd) {
 		struct al5_config_channel config_channel;
 		struct al5_params encode_status;
@@ -100,6 +104,8 @@ static long al5e_ioctl(struct file *filp, unsigned int cmd,
 		struct al5_reconstructed_info rec_msg;
 		struct al5_buffer buffer_msg;
 		u32 rec_fd;
+		struct al5_ring_info ring_info;
+		struct al5_debug_mail debug_mail;
 	case AL_MCU_CONFIG_CHANNEL:
 		ioctl_info("ioctl AL_MCU_CONFIG_CHANNEL from user %i",
 			   user->uid);
@@ -127,6 +133,7 @@ static long al5e_ioctl(struct file *filp, unsigned int cmd,
 		if (copy_from_user(&encode_status, (void *)arg,
 				   sizeof(encode_status)))
 			return -EFAULT;
+		al5_codec_busy_poll(codec, user);
 		ret = al5e_user_wait_for_status(user, &encode_status);
 		if (copy_to_user((void *)arg, &encode_status,
 				 sizeof(encode_status)))
@@ -169,12 +176,69 @@ static long al5e_ioctl(struct file *filp, unsigned int cmd,
 			return -EFAULT;
 		return al5e_user_put_stream_buffer(user, &buffer_msg);
 
+	case AL_MCU_PUT_FIXED_STREAM_BUFFER:
+		if (copy_from_user(&buffer_msg, (void *)arg,
+				   sizeof(buffer_msg)))
+			return -EFAULT;
+		return al5e_user_put_fixed_stream_buffer(user, &buffer_msg);
+
+	case AL_MCU_SETUP_STATUS_RING:
+		ioctl_info("ioctl AL_MCU_SETUP_STATUS_RING from user %i",
+			   user->uid);
+		if (copy_from_user(&ring_info, (void *)arg, sizeof(ring_info)))
+			return -EFAULT;
+		ret = al5_user_setup_status_ring(user, &ring_info);
+		if (ret)
+			return ret;
+		if (copy_to_user((void *)arg, &ring_info, sizeof(ring_info)))
+			return -EFAULT;
+		return 0;
+
+	case AL_MCU_SETUP_SUBMIT_RING:
+		ioctl_info("ioctl AL_MCU_SETUP_SUBMIT_RING from user %i",
+			   user->uid);
+		if (copy_from_user(&ring_info, (void *)arg, sizeof(ring_info)))
+			return -EFAULT;
+		ret = al5e_user_setup_submit_ring(user, &ring_info);
+		if (ret)
+			return ret;
+		if (copy_to_user((void *)arg, &ring_info, sizeof(ring_info)))
+			return -EFAULT;
+		return 0;
+
+	case AL_MCU_SUBMIT_RING_DOORBELL:
+		return al5e_user_submit_ring_doorbell(user);
+
+	case AL_MCU_SET_BUSY_POLL:
+		return al5_codec_set_busy_poll(user, arg);
+
+	case AL_MCU_GET_DEBUG_MAIL:
+		memset(&debug_mail, 0, sizeof(debug_mail));
+		ret = al5_user_get_debug_mail(user, &debug_mail);
+		if (ret)
+			return ret;
+		if (copy_to_user((void *)arg, &debug_mail, sizeof(debug_mail)))
+			return -EFAULT;
+		return 0;
+
 	case GET_DMA_FD:
-		ret = al5_ioctl_get_dma_fd(codec->device, arg);
+		ret = al5_ioctl_get_dma_fd(codec->device, codec->dma_cache,
+					   arg);
 		return ret;
 
+	case GET_DMA_FD_EXT:
+		ret = al5_ioctl_get_dma_fd_ext(codec->device, codec->dma_cache,
+					       codec->dma_flags, arg);
+		return ret;
+
+	case AL_MCU_REGISTER_BUFFERS:
+		return al5_user_register_buffers(user, arg);
+
+	case AL_MCU_UNREGISTER_BUFFERS:
+		return al5_user_unregister_buffers(user);
+
 	case GET_DMA_PHY:
-		ret = al5_ioctl_get_dmabuf_dma_addr(codec->device, arg);
+		ret = al5_ioctl_get_dmabuf_dma_addr(&user->attach_cache, arg);
 		return ret;
 
 	default:
@@ -182,10 +246,30 @@ static long al5e_ioctl(struct file *filp, unsigned int cmd,
 	}
 }
 
+static long al5e_ioctl(struct file *filp, unsigned int cmd,
+		       unsigned long arg)
+{
+	struct al5_filp_data *filp_data = filp->private_data;
+	struct al5_user *user = filp_data->user;
+	long ret;
+
+	/* the mcu was restarted, the file must be closed */
+	if (al5_user_is_reset(user))
+		return -ECONNRESET;
+
+	ret = handle_ioctl(filp, cmd, arg);
+	if (ret && al5_user_is_reset(user))
+		return -ECONNRESET;
+
+	return ret;
+}
+
 static const struct file_operations al5e_fops = {
 	.owner		= THIS_MODULE,
 	.open		= al5_codec_open,
 	.release	= al5_codec_release,
+	.poll		= al5_codec_poll,
+	.mmap		= al5_codec_mmap,
 	.unlocked_ioctl = al5e_ioctl,
 	.compat_ioctl	= al5_codec_compat_ioctl,
 };
@@ -215,7 +299,8 @@ static int al5e_setup_codec_cdev(struct al5_codec_desc *codec, int minor)
 static int al5e_probe(struct platform_device *pdev)
 {
 	int err;
-	static int current_minor;
+	static atomic_t next_minor = ATOMIC_INIT(0);
+	int minor;
 
 	struct al5_codec_desc *codec;
 
@@ -233,18 +318,18 @@ static int al5e_probe(struct platform_device *pdev)
 	err = al5_codec_set_firmware(codec, AL5E_FIRMWARE,
 				     AL5E_BOOTLOADER_FIRMWARE);
 	if (err) {
-		dev_err(&pdev->dev, "Failed to setup firmware");
+		dev_err(&pdev->dev, "Failed to load firmware");
 		al5_codec_tear_down(codec);
 		return err;
 	}
-	err = al5e_setup_codec_cdev(codec, current_minor);
+	minor = atomic_inc_return(&next_minor) - 1;
+	err = al5e_setup_codec_cdev(codec, minor);
 	if (err) {
 		dev_err(&pdev->dev, "Failed to setup cdev");
 		al5_codec_tear_down(codec);
 		return err;
 	}
-	codec->minor = current_minor;
-	++current_minor;
+	codec->minor = minor;
 
 	return 0;
 }
@@ -273,6 +358,7 @@ static struct platform_driver al5e_platform_driver = {
 	.remove			= al5e_remove,
 	.driver			=       {
 		.name		= "al5e",
+		.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
 		.of_match_table = of_match_ptr(al5e_of_match),
 	},
 };
@@ -30,6 +30,8 @@
 
 #define AL_MCU_GET_REC_PICTURE _IOWR('q', 23, struct al5_reconstructed_info)
 #define AL_MCU_RELEASE_REC_PICTURE _IOWR('q', 24, __u32)
+/* handle is the index of a buffer registered with AL_MCU_REGISTER_BUFFERS */
+#define AL_MCU_PUT_FIXED_STREAM_BUFFER _IOWR('q', 25, struct al5_buffer)
 
 
 struct al5_reconstructed_info {
@@ -55,6 +57,7 @@ struct al5_config_channel {
 	struct al5_channel_status status;
 };
 
+/* also the record of the submission ring */
 struct al5_encode_msg {
 	struct al5_params params;
 	struct al5_params addresses;
@@ -37,6 +37,9 @@ struct al5_mail *al5e_create_encode_one_frame_msg(u32 chan_uid,
 
 	const int padding = 0;
 
+	if (!mail)
+		return NULL;
+
 	al5_mail_write_word(mail, chan_uid);
 	al5_mail_write_word(mail, padding);
 	al5_mail_write(mail, msg->params.opaque_params, msg->params.size);
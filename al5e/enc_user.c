@@ -16,9 +16,11 @@
  * You should have received a copy of the GNU General Public License along with
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <linux/kernel.h>
 #include <linux/types.h>
 #include <linux/string.h>
 #include <linux/mutex.h>
+#include <linux/err.h>
 
 #include "enc_user.h"
 #include "enc_mails_factory.h"
@@ -27,8 +29,7 @@
 #include "al_buffers_pool.h"
 
 #define CHECKPOINT_ALLOCATE_BUFFERS 1
-#define CHECKPOINT_SEND_INTERMEDIATE_BUFFERS 2
-#define CHECKPOINT_SEND_REFERENCE_BUFFERS 3
+#define CHECKPOINT_SEND_BUFFERS 2
 
 static void update_chan_param(struct al5_channel_status *status,
 			      struct al5e_feedback_channel *message)
@@ -57,6 +58,8 @@ static struct al5_mail *create_mail_from_bufpool(u32 msg_uid, u32 chan_uid,
 	u32 content_size = bufpool.count * size_per_buffer;
 
 	mail = al5_mail_create(msg_uid, 4 + content_size);
+	if (!mail)
+		return NULL;
 	al5_mail_write_word(mail, chan_uid);
 	for (i = 0; i < bufpool.count; i++) {
 		struct al5_dma_buffer *buffer = bufpool.buffers[i];
@@ -93,22 +96,16 @@ static int allocate_channel_buffers(struct al5_user *user,
 	return 0;
 }
 
-static int send_intermediate_buffers(struct al5_user *user)
+/* intermediate and reference buffers are pushed with a single doorbell */
+static int send_channel_buffers(struct al5_user *user)
 {
-	struct al5_mail *mail;
-
-	mail = create_mail_from_bufpool(AL_MCU_MSG_PUSH_BUFFER_INTERMEDIATE,
-					user->chan_uid, user->int_buffers);
-	return al5_check_and_send(user, mail);
-}
+	struct al5_mail *mails[2];
 
-static int send_reference_buffers(struct al5_user *user)
-{
-	struct al5_mail *mail;
-
-	mail = create_mail_from_bufpool(AL_MCU_MSG_PUSH_BUFFER_REFERENCE,
-					user->chan_uid, user->rec_buffers);
-	return al5_check_and_send(user, mail);
+	mails[0] = create_mail_from_bufpool(AL_MCU_MSG_PUSH_BUFFER_INTERMEDIATE,
+					    user->chan_uid, user->int_buffers);
+	mails[1] = create_mail_from_bufpool(AL_MCU_MSG_PUSH_BUFFER_REFERENCE,
+					    user->chan_uid, user->rec_buffers);
+	return al5_check_and_send_batch(user, mails, ARRAY_SIZE(mails));
 }
 
 static int try_to_create_channel(struct al5_user *user,
@@ -123,8 +120,7 @@ static int try_to_create_channel(struct al5_user *user,
 	if (err)
 		return err;
 
-	err = al5_queue_pop_timeout(&feedback,
-				    &user->queues[AL5_USER_MAIL_CREATE]);
+	err = al5_user_pop_answer(user, AL5_USER_MAIL_CREATE, &feedback);
 	if (err)
 		return err;
 
@@ -181,24 +177,14 @@ int al5e_user_create_channel(struct al5_user *user,
 					     "Failed internal buffers allocation, channel wasn't created");
 			goto fail_allocate;
 		}
-		user->checkpoint = CHECKPOINT_SEND_INTERMEDIATE_BUFFERS;
+		user->checkpoint = CHECKPOINT_SEND_BUFFERS;
 	}
 
-	if (user->checkpoint == CHECKPOINT_SEND_INTERMEDIATE_BUFFERS) {
-		err = send_intermediate_buffers(user);
+	if (user->checkpoint == CHECKPOINT_SEND_BUFFERS) {
+		err = send_channel_buffers(user);
 		if (err) {
 			dev_warn_ratelimited(user->device,
-					     "Failed to send intermediate buffers, channel wasn't created");
-			goto fail;
-		}
-		user->checkpoint = CHECKPOINT_SEND_REFERENCE_BUFFERS;
-	}
-
-	if (user->checkpoint == CHECKPOINT_SEND_REFERENCE_BUFFERS) {
-		err = send_reference_buffers(user);
-		if (err) {
-			dev_warn_ratelimited(user->device,
-					     "Failed to send reference buffers, channel wasn't created");
+					     "Failed to send channel buffers, channel wasn't created");
 			goto fail;
 		}
 		user->checkpoint = NO_CHECKPOINT;
@@ -242,12 +228,43 @@ unlock:
 }
 EXPORT_SYMBOL_GPL(al5e_user_encode_one_frame);
 
+static struct al5_mail *encode_record_to_mail(struct al5_user *user,
+					      void *record)
+{
+	struct al5_encode_msg *msg = record;
+
+	if (msg->params.size > sizeof(msg->params.opaque_params) ||
+	    msg->addresses.size > sizeof(msg->addresses.opaque_params))
+		return ERR_PTR(-EINVAL);
+
+	return al5e_create_encode_one_frame_msg(user->chan_uid, msg);
+}
+
+int al5e_user_setup_submit_ring(struct al5_user *user,
+				struct al5_ring_info *info)
+{
+	return al5_user_setup_submit_ring(user, info,
+					  sizeof(struct al5_encode_msg));
+}
+EXPORT_SYMBOL_GPL(al5e_user_setup_submit_ring);
+
+/* Encode the frames written in the submission ring */
+int al5e_user_submit_ring_doorbell(struct al5_user *user)
+{
+	return al5_user_drain_submit_ring(user, encode_record_to_mail);
+}
+EXPORT_SYMBOL_GPL(al5e_user_submit_ring_doorbell);
+
 int al5e_user_wait_for_status(struct al5_user *user,
 			      struct al5_params *msg)
 {
 	struct al5_mail *feedback;
 	int err = 0;
 
+	/* statuses only go to the ring once it is set up */
+	if (user->status_ring)
+		return -EBUSY;
+
 	if (!mutex_trylock(&user->locks[AL5_USER_STATUS]))
 		return -EINTR;
 
@@ -268,34 +285,68 @@ unlock:
 	return err;
 }
 
+static int send_stream_buffer(struct al5_user *user,
+			      struct al5_buffer *buffer, u32 bus_address,
+			      u32 mcu_vaddr)
+{
+	struct al5_mail *mail;
+
+	mail = al5_mail_create(AL_MCU_MSG_PUT_STREAM_BUFFER, 28);
+	if (!mail)
+		return -ENOMEM;
+	al5_mail_write_word(mail, user->chan_uid);
+	al5_mail_write_word(mail, bus_address);
+	al5_mail_write_word(mail, mcu_vaddr);
+	al5_mail_write_word(mail, buffer->size);
+	al5_mail_write_word(mail, buffer->offset);
+	al5_mail_write(mail, &buffer->stream_buffer_ptr, 8);
+
+	return al5_check_and_send(user, mail);
+}
+
 int al5e_user_put_stream_buffer(struct al5_user *user,
 				struct al5_buffer *buffer)
 {
 	int error;
 	struct al5_buffer_info buffer_info;
-	struct al5_mail *mail;
 	u32 mcu_vaddr;
 
 	if (!al5_chan_is_created(user))
 		return -EPERM;
 
-	error = al5_get_dmabuf_info(user->device, buffer->handle, &buffer_info);
+	error = al5_attach_cache_get_info(&user->attach_cache, buffer->handle,
+					  &buffer_info);
 	if (error)
 		return error;
 
 	if (buffer->size > buffer_info.size)
 		return -EFAULT;
 
-	mail = al5_mail_create(AL_MCU_MSG_PUT_STREAM_BUFFER, 28);
-	al5_mail_write_word(mail, user->chan_uid);
-	al5_mail_write_word(mail, buffer_info.bus_address);
 	mcu_vaddr = al5_mcu_get_virtual_address(buffer_info.bus_address);
-	al5_mail_write_word(mail, mcu_vaddr);
-	al5_mail_write_word(mail, buffer->size);
-	al5_mail_write_word(mail, buffer->offset);
-	al5_mail_write(mail, &buffer->stream_buffer_ptr, 8);
 
-	return al5_check_and_send(user, mail);
+	return send_stream_buffer(user, buffer, buffer_info.bus_address,
+				  mcu_vaddr);
+}
+
+/* Same as al5e_user_put_stream_buffer(), the handle is a registered index */
+int al5e_user_put_fixed_stream_buffer(struct al5_user *user,
+				      struct al5_buffer *buffer)
+{
+	u32 bus_address, mcu_vaddr, size;
+	int error;
+
+	if (!al5_chan_is_created(user))
+		return -EPERM;
+
+	error = al5_buffer_table_get(&user->buffer_table, buffer->handle,
+				     &bus_address, &mcu_vaddr, &size);
+	if (error)
+		return error;
+
+	if (buffer->size > size)
+		return -EFAULT;
+
+	return send_stream_buffer(user, buffer, bus_address, mcu_vaddr);
 }
 
 static int get_user_rec_buffer(struct al5_user *user, int id)
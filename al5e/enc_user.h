@@ -28,6 +28,12 @@ int al5e_user_wait_for_status(struct al5_user *user,
 			      struct al5_params *msg);
 int al5e_user_put_stream_buffer(struct al5_user *user,
 				struct al5_buffer *buffer);
+int al5e_user_put_fixed_stream_buffer(struct al5_user *user,
+				      struct al5_buffer *buffer);
+
+int al5e_user_setup_submit_ring(struct al5_user *user,
+				struct al5_ring_info *info);
+int al5e_user_submit_ring_doorbell(struct al5_user *user);
 
 int al5e_user_release_rec(struct al5_user *user, u32 fd);
 int al5e_user_get_rec(struct al5_user *user,
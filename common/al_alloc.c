@@ -19,6 +19,7 @@
 #include <linux/dma-buf.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/gfp.h>
 
 #include "al_alloc.h"
 
@@ -28,7 +29,40 @@ MODULE_AUTHOR("Sebastien Alaiwan");
 MODULE_AUTHOR("Antoine Gruzelle");
 MODULE_DESCRIPTION("Allegro Common");
 
-struct al5_dma_buffer *al5_alloc_dma(struct device *dev, size_t size)
+/*
+ * Cached buffers come from the linear mapping and are handed to the device
+ * with the streaming api, the cpu caches are maintained by the dma_sync_*
+ * calls of the dmabuf cpu access hooks.
+ */
+static int alloc_cached(struct device *dev, struct al5_dma_buffer *buf)
+{
+	size_t size = PAGE_ALIGN(buf->size);
+
+	buf->cpu_handle = alloc_pages_exact(size, GFP_KERNEL | GFP_DMA |
+					    __GFP_ZERO | __GFP_NOWARN);
+	if (!buf->cpu_handle)
+		return -ENOMEM;
+
+	buf->dma_handle = dma_map_single(dev, buf->cpu_handle, size,
+					 DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(dev, buf->dma_handle)) {
+		free_pages_exact(buf->cpu_handle, size);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void free_cached(struct device *dev, struct al5_dma_buffer *buf)
+{
+	size_t size = PAGE_ALIGN(buf->size);
+
+	dma_unmap_single(dev, buf->dma_handle, size, DMA_BIDIRECTIONAL);
+	free_pages_exact(buf->cpu_handle, size);
+}
+
+struct al5_dma_buffer *al5_alloc_dma_flags(struct device *dev, size_t size,
+					   u32 flags)
 {
 	struct al5_dma_buffer *buf =
 		kmalloc(sizeof(struct al5_dma_buffer),
@@ -38,9 +72,18 @@ struct al5_dma_buffer *al5_alloc_dma(struct device *dev, size_t size)
 		return NULL;
 
 	buf->size = size;
-	buf->cpu_handle = dma_alloc_coherent(dev, buf->size,
-					     &buf->dma_handle,
-					     GFP_KERNEL | GFP_DMA);
+	buf->flags = flags;
+	if (flags & AL5_DMA_FLAG_CACHED) {
+		if (alloc_cached(dev, buf))
+			buf->cpu_handle = NULL;
+	} else if (flags & AL5_DMA_FLAG_WRITE_COMBINE) {
+		buf->cpu_handle = dma_alloc_wc(dev, buf->size, &buf->dma_handle,
+					       GFP_KERNEL | GFP_DMA);
+	} else {
+		buf->cpu_handle = dma_alloc_coherent(dev, buf->size,
+						     &buf->dma_handle,
+						     GFP_KERNEL | GFP_DMA);
+	}
 
 	if (!buf->cpu_handle) {
 		kfree(buf);
@@ -49,11 +92,21 @@ struct al5_dma_buffer *al5_alloc_dma(struct device *dev, size_t size)
 
 	return buf;
 }
+EXPORT_SYMBOL_GPL(al5_alloc_dma_flags);
+
+struct al5_dma_buffer *al5_alloc_dma(struct device *dev, size_t size)
+{
+	return al5_alloc_dma_flags(dev, size, 0);
+}
 EXPORT_SYMBOL_GPL(al5_alloc_dma);
 
 void al5_free_dma(struct device *dev, struct al5_dma_buffer *buf)
 {
-	if (buf)
+	if (buf && (buf->flags & AL5_DMA_FLAG_CACHED))
+		free_cached(dev, buf);
+	else if (buf && (buf->flags & AL5_DMA_FLAG_WRITE_COMBINE))
+		dma_free_wc(dev, buf->size, buf->cpu_handle, buf->dma_handle);
+	else if (buf)
 		dma_free_coherent(dev, buf->size, buf->cpu_handle,
 				  buf->dma_handle);
 	kfree(buf);
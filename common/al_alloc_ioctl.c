@@ -20,7 +20,8 @@
 
 #include <linux/uaccess.h>
 
-int al5_ioctl_get_dma_fd(struct device *dev, unsigned long arg)
+int al5_ioctl_get_dma_fd(struct device *dev, struct al5_dma_cache *cache,
+			 unsigned long arg)
 {
 	struct al5_dma_info info;
 	int err;
@@ -28,7 +29,7 @@ int al5_ioctl_get_dma_fd(struct device *dev, unsigned long arg)
 	if (copy_from_user(&info, (struct al5_dma_info *)arg, sizeof(info)))
 		return -EFAULT;
 
-	err = al5_allocate_dmabuf(dev, info.size, &info.fd);
+	err = al5_allocate_dmabuf(dev, cache, info.size, 0, &info.fd);
 	if (err)
 		return err;
 
@@ -43,17 +44,53 @@ int al5_ioctl_get_dma_fd(struct device *dev, unsigned long arg)
 }
 EXPORT_SYMBOL_GPL(al5_ioctl_get_dma_fd);
 
-int al5_ioctl_get_dmabuf_dma_addr(struct device *dev, unsigned long arg)
+/* flags are the AL5_DMA_FLAG_* the device supports */
+int al5_ioctl_get_dma_fd_ext(struct device *dev, struct al5_dma_cache *cache,
+			     u32 flags, unsigned long arg)
 {
+	struct al5_dma_info_ext info;
+	int err;
+
+	if (copy_from_user(&info, (struct al5_dma_info_ext *)arg,
+			   sizeof(info)))
+		return -EFAULT;
+
+	if (info.flags & ~flags)
+		return -EINVAL;
+	if ((info.flags & AL5_DMA_FLAG_CACHED) &&
+	    (info.flags & AL5_DMA_FLAG_WRITE_COMBINE))
+		return -EINVAL;
+
+	err = al5_allocate_dmabuf(dev, cache, info.size, info.flags,
+				  &info.fd);
+	if (err)
+		return err;
+
+	err = al5_dmabuf_get_address(dev, info.fd, &info.phy_addr);
+	if (err)
+		return err;
+
+	if (copy_to_user((void *)arg, &info, sizeof(info)))
+		return -EFAULT;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_ioctl_get_dma_fd_ext);
+
+int al5_ioctl_get_dmabuf_dma_addr(struct al5_attach_cache *cache,
+				   unsigned long arg)
+{
+	struct al5_buffer_info buffer_info;
 	struct al5_dma_info info;
 	int err;
 
 	if (copy_from_user(&info, (struct al5_dma_info *)arg, sizeof(info)))
 		return -EFAULT;
 
-	err = al5_dmabuf_get_address(dev, info.fd, &info.phy_addr);
+	err = al5_attach_cache_get_info(cache, info.fd, &buffer_info);
 	if (err)
 		return err;
+	info.phy_addr = buffer_info.bus_address;
 
 	if (copy_to_user((void *)arg, &info, sizeof(info)))
 		return -EFAULT;
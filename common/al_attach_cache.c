@@ -0,0 +1,168 @@
+/*
+ * al_attach_cache.c attachments of the dma-bufs given to the mcu, kept
+ * between lookups
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/dma-buf.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/moduleparam.h>
+
+#include "al_attach_cache.h"
+
+static unsigned int attach_cache_entries = 16;
+module_param(attach_cache_entries, uint, 0644);
+MODULE_PARM_DESC(attach_cache_entries,
+		 "Foreign dma-bufs kept attached per user, 0: no cache");
+
+struct attach_entry {
+	struct dma_buf *dbuf;
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+	struct al5_buffer_info info;
+	struct list_head list;
+};
+
+static void put_entry(struct attach_entry *entry)
+{
+	dma_buf_unmap_attachment(entry->attach, entry->sgt, DMA_BIDIRECTIONAL);
+	dma_buf_detach(entry->dbuf, entry->attach);
+	dma_buf_put(entry->dbuf);
+	kfree(entry);
+}
+
+/*
+ * Called with the lock held. Drops the entries beyond max and the ones of
+ * the buffers only the cache still references: they can't be looked up
+ * again and holding them would only keep their memory.
+ */
+static void trim(struct al5_attach_cache *cache, unsigned int max)
+{
+	struct attach_entry *entry, *next;
+
+	list_for_each_entry_safe(entry, next, &cache->entries, list) {
+		if (cache->nb_entries <= max &&
+		    file_count(entry->dbuf->file) > 1)
+			continue;
+		list_del(&entry->list);
+		--cache->nb_entries;
+		put_entry(entry);
+	}
+}
+
+void al5_attach_cache_init(struct al5_attach_cache *cache, struct device *dev)
+{
+	cache->dev = dev;
+	mutex_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->entries);
+	cache->nb_entries = 0;
+}
+EXPORT_SYMBOL_GPL(al5_attach_cache_init);
+
+void al5_attach_cache_flush(struct al5_attach_cache *cache)
+{
+	mutex_lock(&cache->lock);
+	trim(cache, 0);
+	mutex_unlock(&cache->lock);
+}
+EXPORT_SYMBOL_GPL(al5_attach_cache_flush);
+
+/* Called with the lock held, takes the reference of dbuf */
+static int add_entry(struct al5_attach_cache *cache, struct dma_buf *dbuf,
+		     struct al5_buffer_info *info)
+{
+	struct attach_entry *entry;
+	int err;
+
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry) {
+		err = -ENOMEM;
+		goto put_dbuf;
+	}
+
+	entry->dbuf = dbuf;
+	entry->attach = dma_buf_attach(dbuf, cache->dev);
+	if (IS_ERR(entry->attach)) {
+		err = -EINVAL;
+		goto free_entry;
+	}
+	entry->sgt = dma_buf_map_attachment(entry->attach, DMA_BIDIRECTIONAL);
+	if (IS_ERR(entry->sgt)) {
+		err = -EINVAL;
+		goto detach;
+	}
+
+	entry->info.bus_address = sg_dma_address(entry->sgt->sgl);
+	entry->info.size = dbuf->size;
+	*info = entry->info;
+
+	list_add_tail(&entry->list, &cache->entries);
+	++cache->nb_entries;
+	trim(cache, READ_ONCE(attach_cache_entries));
+
+	return 0;
+
+detach:
+	dma_buf_detach(dbuf, entry->attach);
+free_entry:
+	kfree(entry);
+put_dbuf:
+	dma_buf_put(dbuf);
+	return err;
+}
+
+/*
+ * Same as al5_get_dmabuf_info(), but a dma-buf seen recently costs a list
+ * lookup instead of an attach and a map. Every lookup lets go of the
+ * buffers userspace released since the previous one.
+ */
+int al5_attach_cache_get_info(struct al5_attach_cache *cache, u32 fd,
+			      struct al5_buffer_info *info)
+{
+	struct attach_entry *entry;
+	struct dma_buf *dbuf;
+	int err;
+
+	if (!READ_ONCE(attach_cache_entries))
+		return al5_get_dmabuf_info(cache->dev, fd, info);
+
+	dbuf = dma_buf_get(fd);
+	if (IS_ERR(dbuf))
+		return -EINVAL;
+
+	if (al5_dmabuf_own_info(dbuf, cache->dev, info)) {
+		dma_buf_put(dbuf);
+		return 0;
+	}
+
+	mutex_lock(&cache->lock);
+	trim(cache, READ_ONCE(attach_cache_entries));
+	list_for_each_entry(entry, &cache->entries, list) {
+		if (entry->dbuf != dbuf)
+			continue;
+		*info = entry->info;
+		list_move_tail(&entry->list, &cache->entries);
+		mutex_unlock(&cache->lock);
+		dma_buf_put(dbuf);
+		return 0;
+	}
+	err = add_entry(cache, dbuf, info);
+	mutex_unlock(&cache->lock);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_attach_cache_get_info);
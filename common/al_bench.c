@@ -0,0 +1,174 @@
+/*
+ * al_bench.c benchmarks of the driver primitives, run from debugfs
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <linux/dma-mapping.h>
+
+#include "al_bench.h"
+#include "al_alloc.h"
+#include "mcu_utils.h"
+
+/* a mail of the size of the encode and decode messages */
+#define BENCH_COPY_SIZE 1024
+#define BENCH_COPY_ITERATIONS 4096
+
+/* a bitstream sized buffer, within reach of the cached allocations */
+#define BENCH_FILL_SIZE (1024 * 1024)
+#define BENCH_FILL_ITERATIONS 64
+
+typedef int (*copy_fn)(void *dst, void *src, int size);
+
+/* the copies as they were before, with a barrier on each access */
+static int strict_toio_32(void *pdst, void *psrc, int size)
+{
+	__u32 *src = psrc;
+	__u32 *dst = pdst;
+	int i;
+
+	for (i = 0; i < size / 4; ++i)
+		iowrite32(src[i], dst + i);
+	return 0;
+}
+
+static int strict_fromio_32(void *pdst, void *psrc, int size)
+{
+	__u32 *src = psrc;
+	__u32 *dst = pdst;
+	int i;
+
+	for (i = 0; i < size / 4; ++i)
+		dst[i] = ioread32(src + i);
+	return 0;
+}
+
+static int relaxed_toio_32(void *pdst, void *psrc, int size)
+{
+	return memcpy_toio_32(pdst, psrc, size);
+}
+
+static int relaxed_fromio_32(void *pdst, void *psrc, int size)
+{
+	return memcpy_fromio_32(pdst, psrc, size);
+}
+
+/* MB/s of the copy, including the barrier that publishes it */
+static u64 bench_copy(copy_fn copy, void *dst, void *src)
+{
+	u64 start, elapsed;
+	int i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_COPY_ITERATIONS; ++i) {
+		copy(dst, src, BENCH_COPY_SIZE);
+		mb();
+	}
+	elapsed = max_t(u64, ktime_get_ns() - start, 1);
+
+	return div64_u64((u64)BENCH_COPY_SIZE * BENCH_COPY_ITERATIONS *
+			 NSEC_PER_SEC, elapsed * 1024 * 1024);
+}
+
+/*
+ * The mailbox copies against a memory backed stand-in of the mcu region, so
+ * that the cost of the accessors themselves can be compared on any machine.
+ */
+int al5_bench_copy_show(struct seq_file *m, void *unused)
+{
+	void *region, *buf;
+	int err = 0;
+
+	region = kzalloc(BENCH_COPY_SIZE, GFP_KERNEL);
+	buf = kzalloc(BENCH_COPY_SIZE, GFP_KERNEL);
+	if (!region || !buf) {
+		err = -ENOMEM;
+		goto free;
+	}
+
+	seq_printf(m, "%u bytes x %u\n", BENCH_COPY_SIZE,
+		   BENCH_COPY_ITERATIONS);
+	seq_printf(m, "to io, strict: %llu MB/s\n",
+		   bench_copy(strict_toio_32, region, buf));
+	seq_printf(m, "to io, relaxed: %llu MB/s\n",
+		   bench_copy(relaxed_toio_32, region, buf));
+	seq_printf(m, "from io, strict: %llu MB/s\n",
+		   bench_copy(strict_fromio_32, buf, region));
+	seq_printf(m, "from io, relaxed: %llu MB/s\n",
+		   bench_copy(relaxed_fromio_32, buf, region));
+
+free:
+	kfree(buf);
+	kfree(region);
+
+	return err;
+}
+
+/*
+ * MB/s of the cpu filling a buffer for the device, the cached one is
+ * cleaned to memory after each fill as DMA_BUF_IOCTL_SYNC would.
+ * Returns 0 if the buffer can't be allocated.
+ */
+static u64 bench_fill(struct device *dev, u32 flags)
+{
+	struct al5_dma_buffer *buf;
+	u64 start, elapsed;
+	int i;
+
+	buf = al5_alloc_dma_flags(dev, BENCH_FILL_SIZE, flags);
+	if (!buf)
+		return 0;
+
+	start = ktime_get_ns();
+	for (i = 0; i < BENCH_FILL_ITERATIONS; ++i) {
+		/* not zero, arm64 has a faster path for zeroing normal memory */
+		memset(buf->cpu_handle, i | 1, BENCH_FILL_SIZE);
+		if (flags & AL5_DMA_FLAG_CACHED)
+			dma_sync_single_for_device(dev, buf->dma_handle,
+						   BENCH_FILL_SIZE,
+						   DMA_TO_DEVICE);
+		wmb();
+	}
+	elapsed = max_t(u64, ktime_get_ns() - start, 1);
+
+	al5_free_dma(dev, buf);
+
+	return div64_u64((u64)BENCH_FILL_SIZE * BENCH_FILL_ITERATIONS *
+			 NSEC_PER_SEC, elapsed * 1024 * 1024);
+}
+
+/*
+ * The kernel mappings of the buffers have the attributes of the mmap of
+ * each allocation type, so this is what a frame capture would see.
+ */
+int al5_bench_fill(struct seq_file *m, struct device *dev, u32 flags)
+{
+	seq_printf(m, "%u bytes x %u\n", BENCH_FILL_SIZE,
+		   BENCH_FILL_ITERATIONS);
+	seq_printf(m, "coherent: %llu MB/s\n", bench_fill(dev, 0));
+	if (flags & AL5_DMA_FLAG_WRITE_COMBINE)
+		seq_printf(m, "write combine: %llu MB/s\n",
+			   bench_fill(dev, AL5_DMA_FLAG_WRITE_COMBINE));
+	if (flags & AL5_DMA_FLAG_CACHED)
+		seq_printf(m, "cached: %llu MB/s\n",
+			   bench_fill(dev, AL5_DMA_FLAG_CACHED));
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * al_buffer_table.c dma-bufs registered once by a user and then referred to
+ * by index
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/dma-buf.h>
+#include <linux/slab.h>
+
+#include "al_buffer_table.h"
+#include "al_dmabuf.h"
+#include "mcu_interface.h"
+
+static void unpin(struct al5_fixed_buffer *buffer)
+{
+	if (buffer->attach) {
+		dma_buf_unmap_attachment(buffer->attach, buffer->sgt,
+					 DMA_BIDIRECTIONAL);
+		dma_buf_detach(buffer->dbuf, buffer->attach);
+	}
+	dma_buf_put(buffer->dbuf);
+}
+
+static int pin(struct device *dev, u32 fd, struct al5_fixed_buffer *buffer)
+{
+	struct al5_buffer_info info;
+	int err;
+
+	buffer->dbuf = dma_buf_get(fd);
+	if (IS_ERR(buffer->dbuf))
+		return -EINVAL;
+
+	buffer->attach = NULL;
+	buffer->sgt = NULL;
+	if (al5_dmabuf_own_info(buffer->dbuf, dev, &info)) {
+		buffer->bus_address = info.bus_address;
+		goto addresses;
+	}
+
+	buffer->attach = dma_buf_attach(buffer->dbuf, dev);
+	if (IS_ERR(buffer->attach)) {
+		err = -EINVAL;
+		goto put_dbuf;
+	}
+	buffer->sgt = dma_buf_map_attachment(buffer->attach,
+					     DMA_BIDIRECTIONAL);
+	if (IS_ERR(buffer->sgt)) {
+		err = -EINVAL;
+		goto detach;
+	}
+	buffer->bus_address = sg_dma_address(buffer->sgt->sgl);
+
+addresses:
+	buffer->mcu_address = al5_mcu_get_virtual_address(buffer->bus_address);
+	buffer->size = buffer->dbuf->size;
+
+	return 0;
+
+detach:
+	dma_buf_detach(buffer->dbuf, buffer->attach);
+put_dbuf:
+	dma_buf_put(buffer->dbuf);
+	return err;
+}
+
+void al5_buffer_table_init(struct al5_buffer_table *table, struct device *dev)
+{
+	table->dev = dev;
+	mutex_init(&table->lock);
+	table->buffers = NULL;
+	table->nb_buffers = 0;
+}
+EXPORT_SYMBOL_GPL(al5_buffer_table_init);
+
+/*
+ * Pins buffers[i].fd as buffer i and fills in its size and addresses.
+ * A table can only be registered once until it is unregistered.
+ */
+int al5_buffer_table_register(struct al5_buffer_table *table,
+			      struct al5_registered_buffer *buffers,
+			      u32 nb_buffers)
+{
+	struct al5_fixed_buffer *fixed;
+	int err = 0;
+	int i;
+
+	if (nb_buffers == 0 || nb_buffers > AL5_MAX_REGISTERED_BUFFERS)
+		return -EINVAL;
+
+	fixed = kcalloc(nb_buffers, sizeof(*fixed), GFP_KERNEL);
+	if (!fixed)
+		return -ENOMEM;
+
+	for (i = 0; i < nb_buffers; ++i) {
+		err = pin(table->dev, buffers[i].fd, &fixed[i]);
+		if (err)
+			goto unpin;
+		buffers[i].size = fixed[i].size;
+		buffers[i].phy_addr = fixed[i].bus_address;
+		buffers[i].mcu_addr = fixed[i].mcu_address;
+	}
+
+	mutex_lock(&table->lock);
+	if (table->buffers) {
+		mutex_unlock(&table->lock);
+		err = -EBUSY;
+		goto unpin;
+	}
+	table->buffers = fixed;
+	table->nb_buffers = nb_buffers;
+	mutex_unlock(&table->lock);
+
+	return 0;
+
+unpin:
+	while (--i >= 0)
+		unpin(&fixed[i]);
+	kfree(fixed);
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_buffer_table_register);
+
+/* The mcu mustn't be using the buffers anymore */
+int al5_buffer_table_unregister(struct al5_buffer_table *table)
+{
+	struct al5_fixed_buffer *fixed;
+	u32 nb_buffers;
+	int i;
+
+	mutex_lock(&table->lock);
+	fixed = table->buffers;
+	nb_buffers = table->nb_buffers;
+	table->buffers = NULL;
+	table->nb_buffers = 0;
+	mutex_unlock(&table->lock);
+
+	if (!fixed)
+		return -ENXIO;
+
+	for (i = 0; i < nb_buffers; ++i)
+		unpin(&fixed[i]);
+	kfree(fixed);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_buffer_table_unregister);
+
+int al5_buffer_table_get(struct al5_buffer_table *table, u32 index,
+			 u32 *bus_address, u32 *mcu_address, u32 *size)
+{
+	int err = 0;
+
+	mutex_lock(&table->lock);
+	if (index >= table->nb_buffers) {
+		err = -EINVAL;
+		goto unlock;
+	}
+	*bus_address = table->buffers[index].bus_address;
+	*mcu_address = table->buffers[index].mcu_address;
+	*size = table->buffers[index].size;
+
+unlock:
+	mutex_unlock(&table->lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_buffer_table_get);
@@ -20,6 +20,17 @@
 #include <linux/delay.h>
 #include <linux/of_address.h>
 #include <linux/of.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/moduleparam.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
+#include <linux/sched/clock.h>
+#include <linux/sched/signal.h>
+#else
+#include <linux/sched.h>
+#endif
 
 #include "al_mail.h"
 #include "al_codec_mails.h"
@@ -27,6 +38,18 @@
 #include "al_codec.h"
 #include "al_alloc.h"
 #include "mcu_interface.h"
+#include "al_module.h"
+#include "al_bench.h"
+
+static unsigned int busy_poll_max_us = 1000;
+module_param(busy_poll_max_us, uint, 0644);
+MODULE_PARM_DESC(busy_poll_max_us,
+		 "Upper bound of the busy poll time a user can ask for");
+
+static bool auto_recovery = true;
+module_param(auto_recovery, bool, 0644);
+MODULE_PARM_DESC(auto_recovery,
+		 "Restart the mcu when it doesn't answer a command, every channel is lost");
 
 static void set_icache_offset(struct al5_codec_desc *codec)
 {
@@ -87,16 +110,16 @@ static int copy_firmware(struct al5_codec_desc *codec,
 
 static void stop_mcu(struct al5_codec_desc *codec)
 {
-	int time = 0;
+	unsigned long timeout = jiffies + msecs_to_jiffies(100);
 
 	al5_writel(0, AL5_MCU_WAKEUP);
 	al5_writel(MCU_SLEEP_INSTRUCTION, AL5_MCU_INTERRUPT_HANDLER);
 	al5_signal_mcu(codec->users_group.mcu);
 
-	while ((al5_readl(AL5_MCU_STA) & 1) != 1 && time < 100) {
-		msleep(20);
-		time += 20;
-	}
+	/* the mcu is usually asleep well before the first 20ms sleep ended */
+	while ((al5_readl(AL5_MCU_STA) & 1) != 1 &&
+	       time_before(jiffies, timeout))
+		usleep_range(200, 500);
 }
 
 static void reset_mcu(struct al5_codec_desc *codec)
@@ -120,35 +143,6 @@ static void set_mcu_interrupt_mask(struct al5_codec_desc *codec)
 	al5_writel(1, AL5_MCU_INTERRUPT_MASK);
 }
 
-static int request_all_firmwares(struct al5_codec_desc *codec,
-				 const struct firmware **fw,
-				 const struct firmware **bl_fw,
-				 char *fw_file,
-				 char *bl_fw_file)
-{
-	int err;
-
-	err = request_firmware(fw, fw_file, codec->device);
-	if (err) {
-		al5_err("firmware file '%s' not found", fw_file);
-		goto out_failed;
-	}
-
-	err = request_firmware(bl_fw, bl_fw_file, codec->device);
-	if (err) {
-		al5_err("bootloader firmware file '%s' not found",
-			bl_fw_file);
-		goto out_failed_firmware;
-	}
-
-	return 0;
-
-out_failed_firmware:
-	release_firmware(*fw);
-out_failed:
-	return err;
-
-}
 
 static int setup_and_start_mcu(struct al5_codec_desc *codec,
 			       const struct firmware *fw,
@@ -232,14 +226,19 @@ static int init_mcu(struct al5_codec_desc *codec, struct al5_user *root)
 	}
 	al5_free_mail(feedback);
 
-	mcu_memory_pool = MCU_SUBALLOCATOR_SIZE;
-	of_property_read_u32(np, "al,mcu_ext_mem_size", &mcu_memory_pool);
-
-	codec->suballoc_buf = al5_alloc_dma(codec->device, mcu_memory_pool);
+	/* kept from the previous start if the mcu is restarted */
 	if (!codec->suballoc_buf) {
-		err = -ENOMEM;
-		al5_err("Couldn't allocate mcu memory pool");
-		goto unlock;
+		mcu_memory_pool = MCU_SUBALLOCATOR_SIZE;
+		of_property_read_u32(np, "al,mcu_ext_mem_size",
+				     &mcu_memory_pool);
+
+		codec->suballoc_buf = al5_alloc_dma(codec->device,
+						    mcu_memory_pool);
+		if (!codec->suballoc_buf) {
+			err = -ENOMEM;
+			al5_err("Couldn't allocate mcu memory pool");
+			goto unlock;
+		}
 	}
 
 	init_msg.addr = codec->suballoc_buf->dma_handle + MCU_CACHE_OFFSET;
@@ -248,7 +247,14 @@ static int init_mcu(struct al5_codec_desc *codec, struct al5_user *root)
 	al5_info("l2 prefetch size:%d (bits), l2 color bitdepth:%d\n",
 		 init_msg.l2_size_in_bits, init_msg.l2_color_bitdepth);
 
-	err = al5_check_and_send(root, create_init_msg(root->uid, &init_msg));
+	feedback = create_init_msg(root->uid, &init_msg);
+	if (!feedback) {
+		err = -ENOMEM;
+		goto fail_msg;
+	}
+
+	/* lets the users send again if the mcu is restarted */
+	err = al5_mcu_send_init(root->mcu, feedback);
 	if (err) {
 		al5_err("Couldn't send initial configuration to mcu");
 		goto fail_msg;
@@ -274,107 +280,569 @@ unlock:
 
 int al5_codec_open(struct inode *inode, struct file *filp)
 {
-	struct al5_filp_data *private_data = kzalloc(sizeof(*private_data),
-						     GFP_KERNEL);
+	struct al5_filp_data *private_data;
 	struct al5_user *user;
 	struct al5_codec_desc *codec;
 	int err;
 
-	user = kzalloc(sizeof(*user), GFP_KERNEL);
-	if (!user)
-		return -ENOMEM;
 	codec = container_of(inode->i_cdev, struct al5_codec_desc, cdev);
+	if (!completion_done(&codec->mcu_ready)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (wait_for_completion_interruptible(&codec->mcu_ready))
+			return -ERESTARTSYS;
+	}
+	if (codec->mcu_err)
+		return -ENODEV;
 
-	err = al5_group_bind_user(&codec->users_group, user);
-	if (err) {
-		kzfree(user);
-		return err;
+	private_data = kzalloc(sizeof(*private_data), GFP_KERNEL);
+	if (!private_data)
+		return -ENOMEM;
+
+	user = kzalloc(sizeof(*user), GFP_KERNEL);
+	if (!user) {
+		err = -ENOMEM;
+		goto free_private_data;
 	}
 
+	err = al5_group_bind_user(&codec->users_group, user);
+	if (err)
+		goto free_user;
+
 	private_data->codec = codec;
 	private_data->user = user;
 	filp->private_data = private_data;
 
 	return 0;
+
+free_user:
+	kzfree(user);
+free_private_data:
+	kfree(private_data);
+	return err;
 }
 EXPORT_SYMBOL_GPL(al5_codec_open);
 
 void al5_user_destroy_channel_resources(struct al5_user *user);
-int al5_codec_release(struct inode *inode, struct file *filp)
+static void release_user(struct al5_codec_desc *codec, struct al5_user *user)
 {
-	struct al5_filp_data *private_data = filp->private_data;
+	/* best effort. If everything went wrong, still free the channel
+	 * resources to avoid leaks */
+	if (al5_chan_is_created(user))
+		al5_user_destroy_channel_resources(user);
+
+	/* no mail can be delivered to the user once unbound */
+	al5_group_unbind_user(&codec->users_group, user);
+	al5_user_remove_residual_messages(user);
+	al5_user_release_rings(user);
+	al5_attach_cache_flush(&user->attach_cache);
+	al5_buffer_table_unregister(&user->buffer_table);
+	kzfree(user);
+}
+
+#define TEARDOWN_RETRY_MS 1000
+
+/*
+ * The uid and the buffers of the channel are only given back once the mcu
+ * acknowledged the destroy, or once it was restarted: until then the mcu
+ * may still use them. The destroy is retried for as long as it takes, only
+ * the removal of the device gives up on it.
+ */
+static void teardown_user(struct work_struct *work)
+{
+	struct al5_filp_data *private_data =
+		container_of(work, struct al5_filp_data, teardown);
 	struct al5_user *user = private_data->user;
 	struct al5_codec_desc *codec = private_data->codec;
+	int ret;
 
-	if (al5_chan_is_created(user)) {
-		const int quiet = 1;
-
-		/* best effort to destroy the channel if it wasn't already */
-		int ret = -1;
-		int tries = 0;
-		while (ret != 0 && tries < 10000) {
-			ret = al5_user_destroy_channel(user, quiet);
-			++tries;
-		}
-		if (ret != 0)
+	user->nonblock = false;
+	while (!al5_user_is_reset(user)) {
+		ret = al5_user_destroy_channel(user, false);
+		if (ret == 0 || !al5_chan_is_created(user))
+			break;
+		if (READ_ONCE(codec->removing)) {
 			dev_err(codec->device,
 				"Failed to destroy channel on mcu. Something went wrong");
+			break;
+		}
+		dev_warn_ratelimited(codec->device,
+				     "Failed to destroy channel on mcu, retrying");
+		msleep(TEARDOWN_RETRY_MS);
+	}
 
+	release_user(codec, user);
+	kzfree(private_data);
+	atomic_dec(&codec->teardowns_pending);
+}
 
-		/* best effort. If everything went wrong, still free the channel resources
-		 * to avoid leaks */
-		al5_user_destroy_channel_resources(user);
+/* Never waits for the mcu, the channel is destroyed in the background */
+int al5_codec_release(struct inode *inode, struct file *filp)
+{
+	struct al5_filp_data *private_data = filp->private_data;
+	struct al5_user *user = private_data->user;
+	struct al5_codec_desc *codec = private_data->codec;
+
+	/* a channel that died with a previous mcu is only freed */
+	if (al5_chan_is_created(user) && !al5_user_is_reset(user)) {
+		atomic_inc(&codec->teardowns_pending);
+		INIT_WORK(&private_data->teardown, teardown_user);
+		queue_work(codec->teardown_wq, &private_data->teardown);
+		return 0;
 	}
-	al5_user_remove_residual_messages(user);
-	al5_group_unbind_user(&codec->users_group, user);
-	kzfree(user);
-	kzfree(filp->private_data);
+
+	release_user(codec, user);
+	kzfree(private_data);
 
 	return 0;
 }
 EXPORT_SYMBOL_GPL(al5_codec_release);
 
-int al5_codec_set_firmware(struct al5_codec_desc *codec, char *fw_file,
-			   char *bl_fw_file)
+/*
+ * A status is reported as normal data, a reconstructed picture as priority
+ * data and a start code search result as priority band data.
+ */
+unsigned int al5_codec_poll(struct file *filp, poll_table *wait)
+{
+	struct al5_filp_data *private_data = filp->private_data;
+	struct al5_user *user = private_data->user;
+	unsigned int mask = 0;
+
+	if (al5_user_is_reset(user))
+		mask |= POLLERR;
+
+	if (user->status_ring)
+		al5_user_refill_status_ring(user);
+
+	if (al5_queue_poll(&user->queues[AL5_USER_MAIL_STATUS], filp, wait) ||
+	    al5_user_status_is_ready(user))
+		mask |= POLLIN | POLLRDNORM;
+	if (al5_queue_poll(&user->queues[AL5_USER_MAIL_REC], filp, wait))
+		mask |= POLLPRI;
+	if (al5_queue_poll(&user->queues[AL5_USER_MAIL_SC], filp, wait))
+		mask |= POLLRDBAND;
+
+	return mask;
+}
+EXPORT_SYMBOL_GPL(al5_codec_poll);
+
+int al5_codec_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct al5_filp_data *private_data = filp->private_data;
+	struct al5_user *user = private_data->user;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	struct al5_ring *submit_ring = READ_ONCE(user->submit_ring);
+
+	if (offset == AL5_STATUS_RING_OFFSET && user->status_ring)
+		return al5_ring_mmap(user->status_ring, vma);
+	if (offset == AL5_SUBMIT_RING_OFFSET && submit_ring)
+		return al5_ring_mmap(submit_ring, vma);
+
+	return -EINVAL;
+}
+EXPORT_SYMBOL_GPL(al5_codec_mmap);
+
+int al5_codec_set_busy_poll(struct al5_user *user, unsigned long arg)
+{
+	u32 usecs;
+
+	if (copy_from_user(&usecs, (void *)arg, sizeof(usecs)))
+		return -EFAULT;
+
+	WRITE_ONCE(user->busy_poll_us, usecs);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_codec_set_busy_poll);
+
+/*
+ * Before WAIT_FOR_STATUS sleeps, spin on the status mailbox for the busy poll
+ * time of the user and drain it from here, so that the status doesn't have
+ * to go through the irq thread and a wake up. Gives up early if the cpu is
+ * needed elsewhere.
+ */
+void al5_codec_busy_poll(struct al5_codec_desc *codec, struct al5_user *user)
+{
+	struct al5_group *group = &codec->users_group;
+	struct al5_queue *q = &user->queues[AL5_USER_MAIL_STATUS];
+	u32 usecs = min(READ_ONCE(user->busy_poll_us),
+			READ_ONCE(busy_poll_max_us));
+	u64 end;
+
+	if (!usecs || user->status_ring || !al5_queue_is_empty(q))
+		return;
+
+	end = local_clock() + (u64)usecs * NSEC_PER_USEC;
+	do {
+		if (!al5_mcu_is_empty(group->mcu))
+			al5_group_read_mails(group);
+		if (!al5_queue_is_empty(q)) {
+			atomic_inc(&codec->busy_poll_hits);
+			return;
+		}
+		cpu_relax();
+	} while (local_clock() < end && !need_resched() &&
+		 !signal_pending(current));
+
+	atomic_inc(&codec->busy_poll_misses);
+}
+EXPORT_SYMBOL_GPL(al5_codec_busy_poll);
+
+static int start_firmware(struct al5_codec_desc *codec,
+			  const struct firmware *fw,
+			  const struct firmware *bl_fw)
 {
-	const struct firmware *fw = NULL;
-	const struct firmware *bl_fw = NULL;
 	struct al5_user root;
 	int err;
 
-	err = request_all_firmwares(codec, &fw, &bl_fw, fw_file, bl_fw_file);
-	if (err)
-		return err;
-
 	/* We need to bind root before starting the mcu because we are waiting
 	 * for a sync msg
 	 */
 	err = al5_group_bind_user(&codec->users_group, &root);
 	if (err)
-		goto release_firmware;
+		return err;
 
 	err = setup_and_start_mcu(codec, fw, bl_fw);
 	if (err)
-		goto release_firmware;
+		goto unbind;
 
 	/* after this, the mcu is set to send us an interrupt, we can't fail before
 	 * ack'ing it */
 
 	err = init_mcu(codec, &root);
-	if (err) {
+	if (err)
 		stop_mcu(codec);
+
+unbind:
+	al5_group_unbind_user(&codec->users_group, &root);
+	return err;
+}
+
+/* Runs from the firmware loader worker once the firmware is there */
+static void firmware_loaded(const struct firmware *fw, void *context)
+{
+	struct al5_codec_desc *codec = context;
+	const struct firmware *bl_fw = NULL;
+	int err;
+
+	if (!fw) {
+		al5_err("firmware file '%s' not found", codec->fw_file);
+		err = -ENOENT;
+		goto complete;
+	}
+
+	err = request_firmware(&bl_fw, codec->bl_fw_file, codec->device);
+	if (err) {
+		al5_err("bootloader firmware file '%s' not found",
+			codec->bl_fw_file);
 		goto release_firmware;
 	}
-	al5_group_unbind_user(&codec->users_group, &root);
 
+	err = start_firmware(codec, fw, bl_fw);
+	if (err) {
+		al5_err("Failed to setup firmware");
+		goto release_bl_firmware;
+	}
+
+	codec->fw = fw;
+	codec->bl_fw = bl_fw;
+	goto complete;
+
+release_bl_firmware:
+	release_firmware(bl_fw);
 release_firmware:
 	release_firmware(fw);
-	release_firmware(bl_fw);
+complete:
+	codec->mcu_err = err;
+	complete_all(&codec->mcu_ready);
+}
+
+/*
+ * Warm restart of a stuck mcu. The users lose their channel and get
+ * -ECONNRESET, as does any command sent until the mcu is initialized
+ * again. The caches, the memory pool and the firmwares are reused.
+ * Opening the device waits until the mcu is back.
+ */
+static void recover_mcu(struct work_struct *work)
+{
+	struct al5_codec_desc *codec = container_of(work, struct al5_codec_desc,
+						    recovery_work);
+	struct al5_group *group = &codec->users_group;
+	int err;
+
+	/* nothing to restart before the first start is done */
+	wait_for_completion(&codec->mcu_ready);
+	if (!codec->fw)
+		return;
+
+	reinit_completion(&codec->mcu_ready);
+	dev_warn(codec->device, "Restarting the mcu\n");
+
+	al5_mcu_begin_restart(group->mcu);
+	stop_mcu(codec);
+	al5_group_reset_users(group);
+	al5_mcu_reset(group->mcu);
+
+	err = start_firmware(codec, codec->fw, codec->bl_fw);
+	if (err)
+		al5_err("Mcu restart failed");
+	else
+		dev_info(codec->device, "Mcu restarted\n");
+
+	atomic_inc(&codec->recoveries);
+	codec->mcu_err = err;
+	complete_all(&codec->mcu_ready);
+}
+
+void al5_codec_recover(struct al5_codec_desc *codec)
+{
+	schedule_work(&codec->recovery_work);
+}
+EXPORT_SYMBOL_GPL(al5_codec_recover);
+
+static void mcu_hang(void *data)
+{
+	if (READ_ONCE(auto_recovery))
+		al5_codec_recover(data);
+}
+
+/*
+ * Loads the firmwares and starts the mcu in the background. Opening the
+ * device waits for it and fails if the mcu couldn't be started.
+ */
+int al5_codec_set_firmware(struct al5_codec_desc *codec, const char *fw_file,
+			   const char *bl_fw_file)
+{
+	int err;
+
+	codec->fw_file = fw_file;
+	codec->bl_fw_file = bl_fw_file;
+	init_completion(&codec->mcu_ready);
+	INIT_WORK(&codec->recovery_work, recover_mcu);
+	atomic_set(&codec->recoveries, 0);
+	al5_mcu_set_hang_handler(codec->users_group.mcu, mcu_hang, codec);
+
+	err = request_firmware_nowait(THIS_MODULE, true, fw_file,
+				      codec->device, GFP_KERNEL, codec,
+				      firmware_loaded);
+	if (err) {
+		codec->mcu_err = err;
+		complete_all(&codec->mcu_ready);
+	}
+
 	return err;
 }
 EXPORT_SYMBOL_GPL(al5_codec_set_firmware);
 
 
+static int drain_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, al5_group_drain_show, inode->i_private);
+}
+
+static const struct file_operations drain_fops = {
+	.owner = THIS_MODULE,
+	.open = drain_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static ssize_t mcu_traces_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	return al5_group_read_traces(file->private_data, buf, count);
+}
+
+static const struct file_operations mcu_traces_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = mcu_traces_read,
+	.llseek = no_llseek,
+};
+
+static ssize_t trace_filter_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	struct al5_group *group = file->private_data;
+	char filter[AL5_TRACE_FILTER_SIZE + 1];
+	size_t len;
+
+	spin_lock(&group->trace_filter_lock);
+	len = strlcpy(filter, group->trace_filter, sizeof(filter));
+	spin_unlock(&group->trace_filter_lock);
+	filter[len++] = '\n';
+
+	return simple_read_from_buffer(buf, count, ppos, filter, len);
+}
+
+/* an empty filter keeps all the traces */
+static ssize_t trace_filter_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	char filter[AL5_TRACE_FILTER_SIZE];
+	ssize_t len;
+
+	if (*ppos != 0 || count >= sizeof(filter))
+		return -EINVAL;
+
+	len = simple_write_to_buffer(filter, sizeof(filter) - 1, ppos, buf,
+				     count);
+	if (len < 0)
+		return len;
+	filter[len] = '\0';
+
+	al5_group_set_trace_filter(file->private_data, strim(filter));
+
+	return len;
+}
+
+static const struct file_operations trace_filter_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = trace_filter_read,
+	.write = trace_filter_write,
+	.llseek = default_llseek,
+};
+
+static ssize_t max_users_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	struct al5_group *group = file->private_data;
+	char value[16];
+	int len;
+
+	len = scnprintf(value, sizeof(value), "%u\n",
+			READ_ONCE(group->max_users_nb));
+
+	return simple_read_from_buffer(buf, count, ppos, value, len);
+}
+
+static ssize_t max_users_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	char value[16];
+	unsigned int max_users_nb;
+	ssize_t len;
+	int err;
+
+	if (*ppos != 0 || count >= sizeof(value))
+		return -EINVAL;
+
+	len = simple_write_to_buffer(value, sizeof(value) - 1, ppos, buf,
+				     count);
+	if (len < 0)
+		return len;
+	value[len] = '\0';
+
+	err = kstrtouint(strim(value), 0, &max_users_nb);
+	if (err)
+		return err;
+
+	err = al5_group_set_max_users(file->private_data, max_users_nb);
+	if (err)
+		return err;
+
+	return len;
+}
+
+static const struct file_operations max_users_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = max_users_read,
+	.write = max_users_write,
+	.llseek = default_llseek,
+};
+
+static ssize_t recover_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	al5_codec_recover(file->private_data);
+
+	return count;
+}
+
+static const struct file_operations recover_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = recover_write,
+	.llseek = no_llseek,
+};
+
+static int dma_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, al5_dma_cache_show, inode->i_private);
+}
+
+static const struct file_operations dma_cache_fops = {
+	.owner = THIS_MODULE,
+	.open = dma_cache_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int fill_bench_show(struct seq_file *m, void *unused)
+{
+	struct al5_codec_desc *codec = m->private;
+
+	return al5_bench_fill(m, codec->device, codec->dma_flags);
+}
+
+static int fill_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fill_bench_show, inode->i_private);
+}
+
+static const struct file_operations fill_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = fill_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void codec_debugfs_init(struct al5_codec_desc *codec)
+{
+	struct dentry *root = al5_debugfs_root();
+
+	codec->debugfs = NULL;
+	if (!root)
+		return;
+
+	codec->debugfs = debugfs_create_dir(dev_name(codec->device), root);
+	if (IS_ERR_OR_NULL(codec->debugfs)) {
+		codec->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("max_users", 0644, codec->debugfs,
+			    &codec->users_group, &max_users_fops);
+	debugfs_create_file("mailbox_drain", 0444, codec->debugfs,
+			    &codec->users_group, &drain_fops);
+	debugfs_create_atomic_t("busy_poll_hits", 0444, codec->debugfs,
+				&codec->busy_poll_hits);
+	debugfs_create_atomic_t("busy_poll_misses", 0444, codec->debugfs,
+				&codec->busy_poll_misses);
+	debugfs_create_file("mcu_traces", 0400, codec->debugfs,
+			    &codec->users_group, &mcu_traces_fops);
+	debugfs_create_atomic_t("mcu_traces_dropped", 0444, codec->debugfs,
+				&codec->users_group.traces_dropped);
+	debugfs_create_file("mcu_trace_filter", 0600, codec->debugfs,
+			    &codec->users_group, &trace_filter_fops);
+	debugfs_create_file("recover", 0200, codec->debugfs, codec,
+			    &recover_fops);
+	debugfs_create_atomic_t("mcu_recoveries", 0444, codec->debugfs,
+				&codec->recoveries);
+	debugfs_create_atomic_t("teardowns_pending", 0444, codec->debugfs,
+				&codec->teardowns_pending);
+	if (codec->dma_cache)
+		debugfs_create_file("dma_cache", 0444, codec->debugfs,
+				    codec->dma_cache, &dma_cache_fops);
+	debugfs_create_file("fill_bench", 0400, codec->debugfs,
+			    codec, &fill_bench_fops);
+}
+
 int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 		     size_t max_users_nb)
 {
@@ -401,6 +869,7 @@ int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 		err = irq;
 		goto fail;
 	}
+	codec->irq = irq;
 
 	codec->regs = devm_ioremap_nocache(&pdev->dev,
 					   res->start, resource_size(res));
@@ -412,10 +881,13 @@ int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 		goto fail;
 	}
 
+	codec->dma_flags = AL5_DMA_FLAGS;
 	mem_node = of_parse_phandle(pdev->dev.of_node, "xlnx,dedicated-mem", 0);
 	if (mem_node) {
 		err = of_address_to_resource(mem_node, 0, &mem_res);
 		if (!err) {
+			/* cached buffers come from the page allocator */
+			codec->dma_flags &= ~AL5_DMA_FLAG_CACHED;
 			err = dma_declare_coherent_memory(&pdev->dev,
 							  mem_res.start, mem_res.start,
 							  resource_size(&mem_res),
@@ -442,12 +914,28 @@ int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 		goto fail;
 	}
 
-	al5_group_init(&codec->users_group, mcu, max_users_nb, codec->device);
+	err = al5_group_init(&codec->users_group, mcu, max_users_nb,
+			     codec->device);
+	if (err)
+		goto fail;
+
+	/* unbound, a close doesn't wait for the teardown of the others */
+	codec->teardown_wq = alloc_workqueue("%s_teardown", WQ_UNBOUND, 0,
+					     device_name);
+	if (!codec->teardown_wq) {
+		err = -ENOMEM;
+		goto deinit_group;
+	}
+	atomic_set(&codec->teardowns_pending, 0);
+	codec->removing = false;
+
+	/* buffers are only allocated without it */
+	codec->dma_cache = al5_dma_cache_create(codec->device);
 
 	err = alloc_mcu_caches(codec);
 	if (err) {
 		dev_err(&pdev->dev, "icache failed to be allocated");
-		goto fail;
+		goto destroy_teardown_wq;
 	}
 
 	err = devm_request_threaded_irq(codec->device,
@@ -461,6 +949,7 @@ int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 		goto free_mcu_caches;
 	}
 
+	codec_debugfs_init(codec);
 	platform_set_drvdata(pdev, codec);
 
 	return 0;
@@ -468,6 +957,11 @@ int al5_codec_set_up(struct al5_codec_desc *codec, struct platform_device *pdev,
 free_mcu_caches:
 	al5_free_dma(codec->device, codec->icache);
 	codec->icache = NULL;
+destroy_teardown_wq:
+	al5_dma_cache_destroy(codec->dma_cache);
+	destroy_workqueue(codec->teardown_wq);
+deinit_group:
+	al5_group_deinit(&codec->users_group);
 fail:
 	dma_release_declared_memory(&pdev->dev);
 	return err;
@@ -479,8 +973,22 @@ void al5_codec_tear_down(struct al5_codec_desc *codec)
 {
 	struct al5_group *group = &codec->users_group;
 
-	al5_mcu_interface_destroy(group->mcu, codec->device);
+	debugfs_remove_recursive(codec->debugfs);
+	/* the teardowns the mcu doesn't answer give up */
+	WRITE_ONCE(codec->removing, true);
+	destroy_workqueue(codec->teardown_wq);
+	al5_mcu_set_hang_handler(group->mcu, NULL, NULL);
+	cancel_work_sync(&codec->recovery_work);
+	/* the mcu may still be starting */
+	wait_for_completion(&codec->mcu_ready);
+	release_firmware(codec->fw);
+	release_firmware(codec->bl_fw);
+	/* nothing may queue a drain of the mailbox anymore */
+	devm_free_irq(codec->device, codec->irq, codec);
+	/* the group may still be draining the mailbox */
 	al5_group_deinit(group);
+	al5_mcu_interface_destroy(group->mcu, codec->device);
+	al5_dma_cache_destroy(codec->dma_cache);
 	al5_free_dma(codec->device, codec->suballoc_buf);
 	al5_free_dma(codec->device, codec->icache);
 	dma_release_declared_memory(codec->device);
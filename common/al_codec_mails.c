@@ -50,6 +50,8 @@ struct al5_mail *al5_create_empty_mail(u32 sender_uid, u32 msg_uid)
 {
 	struct al5_mail *mail = al5_mail_create(msg_uid, uid_size);
 
+	if (!mail)
+		return NULL;
 	al5_mail_write_word(mail, sender_uid);
 	return mail;
 }
@@ -0,0 +1,339 @@
+/*
+ * al_dma_cache.c recycling of the dma buffers given to userspace
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/slab.h>
+#include <linux/dma-mapping.h>
+#include <linux/string.h>
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>
+#include <linux/sched.h>
+#include <linux/pid.h>
+
+#include "al_dma_cache.h"
+
+static unsigned int dma_cache_budget_kb = 32 * 1024;
+module_param(dma_cache_budget_kb, uint, 0644);
+MODULE_PARM_DESC(dma_cache_budget_kb,
+		 "Bytes of released dma buffers kept per device for reuse, in kB (0: no cache)");
+
+static bool dma_cache_scrub = true;
+module_param(dma_cache_scrub, bool, 0644);
+MODULE_PARM_DESC(dma_cache_scrub,
+		 "Zero a released dma buffer before another process reuses it. This writes the whole buffer, and flushes it for cached ones: unset only if the processes using the device trust each other");
+
+struct size_bucket {
+	u32 size;
+	u32 flags;
+	struct list_head buffers;
+	struct list_head list;
+};
+
+struct cached_buffer {
+	struct al5_dma_buffer *buffer;
+	struct size_bucket *bucket;
+	/* the process the buffer was last allocated for */
+	struct pid *owner;
+	/* in the free list of its size */
+	struct list_head bucket_list;
+	/* in the lru list of the cache, oldest first */
+	struct list_head lru;
+};
+
+static size_t budget_bytes(void)
+{
+	return (size_t)READ_ONCE(dma_cache_budget_kb) * 1024;
+}
+
+/* Called with the lock held */
+static struct size_bucket *find_bucket(struct al5_dma_cache *cache, u32 size,
+				       u32 flags)
+{
+	struct size_bucket *bucket;
+
+	list_for_each_entry(bucket, &cache->buckets, list)
+		if (bucket->size == size && bucket->flags == flags)
+			return bucket;
+
+	return NULL;
+}
+
+/* Called with the lock held, unlinks the entry from the cache */
+static void take_cached(struct al5_dma_cache *cache,
+			struct cached_buffer *cached)
+{
+	struct size_bucket *bucket = cached->bucket;
+
+	list_del(&cached->bucket_list);
+	list_del(&cached->lru);
+	cache->cached_bytes -= cached->buffer->size;
+	--cache->nb_cached;
+
+	if (list_empty(&bucket->buffers)) {
+		list_del(&bucket->list);
+		kfree(bucket);
+	}
+}
+
+/* Called with the lock held, moves the oldest entries to the evicted list */
+static unsigned long evict(struct al5_dma_cache *cache, size_t max_bytes,
+			   unsigned long max_buffers, struct list_head *evicted)
+{
+	struct cached_buffer *cached;
+	unsigned long nb_evicted = 0;
+
+	while ((cache->cached_bytes > max_bytes || nb_evicted < max_buffers) &&
+	       !list_empty(&cache->lru)) {
+		cached = list_first_entry(&cache->lru, struct cached_buffer,
+					  lru);
+		take_cached(cache, cached);
+		list_add_tail(&cached->lru, evicted);
+		++nb_evicted;
+	}
+
+	return nb_evicted;
+}
+
+static void free_evicted(struct al5_dma_cache *cache,
+			 struct list_head *evicted)
+{
+	struct cached_buffer *cached, *next;
+
+	list_for_each_entry_safe(cached, next, evicted, lru) {
+		al5_free_dma(cache->dev, cached->buffer);
+		put_pid(cached->owner);
+		kfree(cached);
+	}
+}
+
+static unsigned long count_cached(struct shrinker *shrinker,
+				  struct shrink_control *sc)
+{
+	struct al5_dma_cache *cache =
+		container_of(shrinker, struct al5_dma_cache, shrinker);
+
+	return READ_ONCE(cache->nb_cached);
+}
+
+static unsigned long scan_cached(struct shrinker *shrinker,
+				 struct shrink_control *sc)
+{
+	struct al5_dma_cache *cache =
+		container_of(shrinker, struct al5_dma_cache, shrinker);
+	unsigned long nb_freed;
+	LIST_HEAD(evicted);
+
+	if (!mutex_trylock(&cache->lock))
+		return SHRINK_STOP;
+	nb_freed = evict(cache, SIZE_MAX, sc->nr_to_scan, &evicted);
+	mutex_unlock(&cache->lock);
+
+	free_evicted(cache, &evicted);
+	atomic_add(nb_freed, &cache->shrunk);
+
+	return nb_freed;
+}
+
+struct al5_dma_cache *al5_dma_cache_create(struct device *dev)
+{
+	struct al5_dma_cache *cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+
+	if (!cache)
+		return NULL;
+
+	cache->dev = get_device(dev);
+	kref_init(&cache->ref);
+	mutex_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->buckets);
+	INIT_LIST_HEAD(&cache->lru);
+
+	cache->shrinker.count_objects = count_cached;
+	cache->shrinker.scan_objects = scan_cached;
+	cache->shrinker.seeks = DEFAULT_SEEKS;
+	if (register_shrinker(&cache->shrinker)) {
+		put_device(cache->dev);
+		kfree(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+EXPORT_SYMBOL_GPL(al5_dma_cache_create);
+
+static void release_cache(struct kref *ref)
+{
+	struct al5_dma_cache *cache =
+		container_of(ref, struct al5_dma_cache, ref);
+
+	put_device(cache->dev);
+	kfree(cache);
+}
+
+/* Buffers still in use are freed when they are released */
+void al5_dma_cache_destroy(struct al5_dma_cache *cache)
+{
+	LIST_HEAD(evicted);
+
+	if (!cache)
+		return;
+
+	unregister_shrinker(&cache->shrinker);
+
+	mutex_lock(&cache->lock);
+	cache->dead = true;
+	evict(cache, 0, 0, &evicted);
+	mutex_unlock(&cache->lock);
+
+	free_evicted(cache, &evicted);
+	kref_put(&cache->ref, release_cache);
+}
+EXPORT_SYMBOL_GPL(al5_dma_cache_destroy);
+
+/* The next process mustn't see what the previous one left */
+static void scrub(struct al5_dma_cache *cache, struct al5_dma_buffer *buffer)
+{
+	memset(buffer->cpu_handle, 0, buffer->size);
+	if (buffer->flags & AL5_DMA_FLAG_CACHED)
+		dma_sync_single_for_device(cache->dev, buffer->dma_handle,
+					   PAGE_ALIGN(buffer->size),
+					   DMA_TO_DEVICE);
+}
+
+/* A buffer used by another process before is zeroed, see dma_cache_scrub */
+struct al5_dma_buffer *al5_dma_cache_alloc(struct al5_dma_cache *cache,
+					   size_t size, u32 flags)
+{
+	struct al5_dma_buffer *buffer = NULL;
+	struct cached_buffer *cached = NULL;
+	struct size_bucket *bucket;
+
+	mutex_lock(&cache->lock);
+	bucket = find_bucket(cache, size, flags);
+	if (bucket) {
+		cached = list_first_entry(&bucket->buffers,
+					  struct cached_buffer, bucket_list);
+		take_cached(cache, cached);
+	}
+	mutex_unlock(&cache->lock);
+
+	if (cached) {
+		buffer = cached->buffer;
+		if (READ_ONCE(dma_cache_scrub) &&
+		    cached->owner != task_tgid(current))
+			scrub(cache, buffer);
+		put_pid(cached->owner);
+		kfree(cached);
+		atomic_inc(&cache->hits);
+	} else {
+		atomic_inc(&cache->misses);
+		buffer = al5_alloc_dma_flags(cache->dev, size, flags);
+		if (!buffer)
+			return NULL;
+	}
+
+	kref_get(&cache->ref);
+
+	return buffer;
+}
+EXPORT_SYMBOL_GPL(al5_dma_cache_alloc);
+
+/* owner is the process the buffer was allocated for */
+void al5_dma_cache_free(struct al5_dma_cache *cache,
+			struct al5_dma_buffer *buffer, struct pid *owner)
+{
+	struct cached_buffer *cached;
+	struct size_bucket *bucket;
+	size_t budget = budget_bytes();
+	unsigned long nb_evicted;
+	LIST_HEAD(evicted);
+
+	if (buffer->size > budget)
+		goto free;
+
+	cached = kmalloc(sizeof(*cached), GFP_KERNEL);
+	if (!cached)
+		goto free;
+
+	mutex_lock(&cache->lock);
+	bucket = find_bucket(cache, buffer->size, buffer->flags);
+	if (!bucket && !cache->dead) {
+		bucket = kmalloc(sizeof(*bucket), GFP_KERNEL);
+		if (bucket) {
+			bucket->size = buffer->size;
+			bucket->flags = buffer->flags;
+			INIT_LIST_HEAD(&bucket->buffers);
+			list_add(&bucket->list, &cache->buckets);
+		}
+	}
+	if (!bucket) {
+		mutex_unlock(&cache->lock);
+		kfree(cached);
+		goto free;
+	}
+
+	cached->buffer = buffer;
+	cached->bucket = bucket;
+	cached->owner = get_pid(owner);
+	list_add_tail(&cached->bucket_list, &bucket->buffers);
+	list_add_tail(&cached->lru, &cache->lru);
+	cache->cached_bytes += buffer->size;
+	++cache->nb_cached;
+
+	nb_evicted = evict(cache, budget, 0, &evicted);
+	mutex_unlock(&cache->lock);
+
+	free_evicted(cache, &evicted);
+	atomic_add(nb_evicted, &cache->evictions);
+	kref_put(&cache->ref, release_cache);
+	return;
+
+free:
+	al5_free_dma(cache->dev, buffer);
+	kref_put(&cache->ref, release_cache);
+}
+EXPORT_SYMBOL_GPL(al5_dma_cache_free);
+
+int al5_dma_cache_show(struct seq_file *m, void *unused)
+{
+	struct al5_dma_cache *cache = m->private;
+	struct size_bucket *bucket;
+	struct cached_buffer *cached;
+	unsigned long nb;
+
+	seq_printf(m, "hits: %d\n", atomic_read(&cache->hits));
+	seq_printf(m, "misses: %d\n", atomic_read(&cache->misses));
+	seq_printf(m, "evictions: %d\n", atomic_read(&cache->evictions));
+	seq_printf(m, "shrunk: %d\n", atomic_read(&cache->shrunk));
+
+	mutex_lock(&cache->lock);
+	seq_printf(m, "cached: %zu bytes in %lu buffers\n",
+		   cache->cached_bytes, cache->nb_cached);
+	list_for_each_entry(bucket, &cache->buckets, list) {
+		nb = 0;
+		list_for_each_entry(cached, &bucket->buffers, bucket_list)
+			++nb;
+		seq_printf(m, "  %u bytes%s: %lu\n", bucket->size,
+			   bucket->flags & AL5_DMA_FLAG_CACHED ? " cached" :
+			   bucket->flags & AL5_DMA_FLAG_WRITE_COMBINE ? " wc" :
+			   "",
+			   nb);
+	}
+	mutex_unlock(&cache->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_dma_cache_show);
@@ -23,6 +23,8 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/pid.h>
 
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Kevin Grandemange");
@@ -32,6 +34,10 @@ MODULE_DESCRIPTION("Allegro Common");
 
 struct al5_dmabuf_priv {
 	struct al5_dma_buffer *buffer;
+	/* the buffer goes back there on release, if set */
+	struct al5_dma_cache *cache;
+	/* the process the buffer was allocated for, if cache is set */
+	struct pid *owner;
 
 	/* DMABUF related */
 	struct device *dev;
@@ -163,8 +169,20 @@ static int al5_dmabuf_mmap(struct dma_buf *buf, struct vm_area_struct *vma)
 
 	vma->vm_pgoff = 0;
 
-	ret = dma_mmap_coherent(dinfo->dev, vma, buffer->cpu_handle,
-				buffer->dma_handle, vsize);
+	if (buffer->flags & AL5_DMA_FLAG_CACHED) {
+		/* same attributes as the linear mapping of these pages */
+		if (vsize > PAGE_ALIGN(buffer->size))
+			return -EINVAL;
+		ret = remap_pfn_range(vma, start,
+				      PHYS_PFN(virt_to_phys(buffer->cpu_handle)),
+				      vsize, vma->vm_page_prot);
+	} else if (buffer->flags & AL5_DMA_FLAG_WRITE_COMBINE) {
+		ret = dma_mmap_wc(dinfo->dev, vma, buffer->cpu_handle,
+				  buffer->dma_handle, vsize);
+	} else {
+		ret = dma_mmap_coherent(dinfo->dev, vma, buffer->cpu_handle,
+					buffer->dma_handle, vsize);
+	}
 
 	if (ret < 0) {
 		pr_err("Remapping memory failed, error: %d\n", ret);
@@ -187,11 +205,14 @@ static void al5_dmabuf_release(struct dma_buf *buf)
 	}
 
 
-	dma_free_coherent(dinfo->dev, buffer->size, buffer->cpu_handle,
-			  buffer->dma_handle);
+	if (dinfo->cache) {
+		al5_dma_cache_free(dinfo->cache, buffer, dinfo->owner);
+		put_pid(dinfo->owner);
+	} else {
+		al5_free_dma(dinfo->dev, buffer);
+	}
 
 	put_device(dinfo->dev);
-	kzfree(buffer);
 	kfree(dinfo);
 }
 
@@ -211,6 +232,35 @@ static void *al5_dmabuf_vmap(struct dma_buf *dbuf)
 	return vaddr;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
+/* Coherent buffers need nothing, cached ones follow DMA_BUF_IOCTL_SYNC */
+static int al5_dmabuf_begin_cpu_access(struct dma_buf *dbuf,
+				       enum dma_data_direction dir)
+{
+	struct al5_dmabuf_priv *dinfo = dbuf->priv;
+	struct al5_dma_buffer *buffer = dinfo->buffer;
+
+	if (buffer->flags & AL5_DMA_FLAG_CACHED)
+		dma_sync_single_for_cpu(dinfo->dev, buffer->dma_handle,
+					PAGE_ALIGN(buffer->size), dir);
+
+	return 0;
+}
+
+static int al5_dmabuf_end_cpu_access(struct dma_buf *dbuf,
+				     enum dma_data_direction dir)
+{
+	struct al5_dmabuf_priv *dinfo = dbuf->priv;
+	struct al5_dma_buffer *buffer = dinfo->buffer;
+
+	if (buffer->flags & AL5_DMA_FLAG_CACHED)
+		dma_sync_single_for_device(dinfo->dev, buffer->dma_handle,
+					   PAGE_ALIGN(buffer->size), dir);
+
+	return 0;
+}
+#endif
+
 static const struct dma_buf_ops al5_dmabuf_ops = {
 	.attach		= al5_dmabuf_attach,
 	.detach		= al5_dmabuf_detach,
@@ -224,6 +274,10 @@ static const struct dma_buf_ops al5_dmabuf_ops = {
 	.kmap		= al5_dmabuf_kmap,
 #endif
 	.vmap		= al5_dmabuf_vmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 6, 0)
+	.begin_cpu_access = al5_dmabuf_begin_cpu_access,
+	.end_cpu_access	= al5_dmabuf_end_cpu_access,
+#endif
 	.mmap		= al5_dmabuf_mmap,
 	.release	= al5_dmabuf_release,
 };
@@ -252,6 +306,17 @@ static struct sg_table *al5_get_base_sgt(struct al5_dmabuf_priv *dinfo)
 	if (!sgt)
 		return NULL;
 
+	if (buf->flags & AL5_DMA_FLAG_CACHED) {
+		ret = sg_alloc_table(sgt, 1, GFP_KERNEL);
+		if (ret < 0) {
+			kfree(sgt);
+			return NULL;
+		}
+		sg_set_page(sgt->sgl, virt_to_page(buf->cpu_handle),
+			    PAGE_ALIGN(buf->size), 0);
+		return sgt;
+	}
+
 	ret = dma_get_sgtable(dev, sgt, buf->cpu_handle, buf->dma_handle,
 			      buf->size);
 	if (ret < 0) {
@@ -291,8 +356,8 @@ static struct dma_buf *al5_get_dmabuf(void *dma_info_priv)
 	return dbuf;
 }
 
-void *al5_dmabuf_wrap(struct device *dev, unsigned long size,
-		      struct al5_dma_buffer *buffer)
+static void *wrap(struct device *dev, unsigned long size,
+		  struct al5_dma_buffer *buffer, struct al5_dma_cache *cache)
 {
 	struct al5_dmabuf_priv *dinfo;
 	struct dma_buf *dbuf;
@@ -303,6 +368,7 @@ void *al5_dmabuf_wrap(struct device *dev, unsigned long size,
 
 	dinfo->dev = get_device(dev);
 	dinfo->buffer = buffer;
+	dinfo->cache = cache;
 	dinfo->dma_dir = DMA_BIDIRECTIONAL;
 	dinfo->sgt_base = al5_get_base_sgt(dinfo);
 
@@ -310,8 +376,17 @@ void *al5_dmabuf_wrap(struct device *dev, unsigned long size,
 	if (IS_ERR_OR_NULL(dbuf))
 		return ERR_PTR(-EINVAL);
 
+	if (cache)
+		dinfo->owner = get_pid(task_tgid(current));
+
 	return dbuf;
 }
+
+void *al5_dmabuf_wrap(struct device *dev, unsigned long size,
+		      struct al5_dma_buffer *buffer)
+{
+	return wrap(dev, size, buffer, NULL);
+}
 EXPORT_SYMBOL_GPL(al5_dmabuf_wrap);
 
 int al5_create_dmabuf_fd(struct device *dev, unsigned long size,
@@ -325,21 +400,62 @@ int al5_create_dmabuf_fd(struct device *dev, unsigned long size,
 }
 EXPORT_SYMBOL_GPL(al5_create_dmabuf_fd);
 
-int al5_allocate_dmabuf(struct device *dev, int size, u32 *fd)
+/* The buffer is taken from the cache and goes back to it, if there is one */
+int al5_allocate_dmabuf(struct device *dev, struct al5_dma_cache *cache,
+			int size, u32 flags, u32 *fd)
 {
 	struct al5_dma_buffer *buffer;
+	struct dma_buf *dbuf;
+	int ret;
 
-	buffer = al5_alloc_dma(dev, size);
+	if (cache)
+		buffer = al5_dma_cache_alloc(cache, size, flags);
+	else
+		buffer = al5_alloc_dma_flags(dev, size, flags);
 	if (!buffer) {
 		dev_err(dev, "Can't alloc DMA buffer of size %d", size);
 		return -ENOMEM;
 	}
 
-	*fd = al5_create_dmabuf_fd(dev, size, buffer);
+	dbuf = wrap(dev, size, buffer, cache);
+	if (IS_ERR(dbuf)) {
+		if (cache)
+			al5_dma_cache_free(cache, buffer, task_tgid(current));
+		else
+			al5_free_dma(dev, buffer);
+		return PTR_ERR(dbuf);
+	}
+
+	ret = dma_buf_fd(dbuf, O_RDWR);
+	if (ret < 0) {
+		dma_buf_put(dbuf);
+		return ret;
+	}
+
+	*fd = ret;
 	return 0;
 }
 EXPORT_SYMBOL_GPL(al5_allocate_dmabuf);
 
+/*
+ * The buffers allocated by the driver for dev already know their bus
+ * address, no need to attach to them. Returns false for the other ones.
+ */
+bool al5_dmabuf_own_info(struct dma_buf *dbuf, struct device *dev,
+			 struct al5_buffer_info *info)
+{
+	struct al5_dmabuf_priv *dinfo = dbuf->priv;
+
+	if (dbuf->ops != &al5_dmabuf_ops || dinfo->dev != dev)
+		return false;
+
+	info->bus_address = dinfo->buffer->dma_handle;
+	info->size = dbuf->size;
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(al5_dmabuf_own_info);
+
 int al5_get_dmabuf_info(struct device *dev, u32 fd,
 			struct al5_buffer_info *info)
 {
@@ -351,10 +467,12 @@ int al5_get_dmabuf_info(struct device *dev, u32 fd,
 	dbuf = dma_buf_get(fd);
 	if (IS_ERR(dbuf))
 		return -EINVAL;
+	if (al5_dmabuf_own_info(dbuf, dev, info))
+		goto put;
 	attach = dma_buf_attach(dbuf, dev);
 	if (IS_ERR(attach)) {
 		err = -EINVAL;
-		goto fail_attach;
+		goto put;
 	}
 	sgt = dma_buf_map_attachment(attach, DMA_BIDIRECTIONAL);
 	if (IS_ERR(sgt)) {
@@ -368,7 +486,7 @@ int al5_get_dmabuf_info(struct device *dev, u32 fd,
 	dma_buf_unmap_attachment(attach, sgt, DMA_BIDIRECTIONAL);
 fail_map:
 	dma_buf_detach(dbuf, attach);
-fail_attach:
+put:
 	dma_buf_put(dbuf);
 	return err;
 }
@@ -379,15 +497,20 @@ int al5_dmabuf_get_address(struct device *dev, u32 fd, u32 *bus_address)
 	struct dma_buf *dbuf;
 	struct dma_buf_attachment *attach;
 	struct sg_table *sgt;
+	struct al5_buffer_info info;
 	int err = 0;
 
 	dbuf = dma_buf_get(fd);
 	if (IS_ERR(dbuf))
 		return -EINVAL;
+	if (al5_dmabuf_own_info(dbuf, dev, &info)) {
+		*bus_address = info.bus_address;
+		goto put;
+	}
 	attach = dma_buf_attach(dbuf, dev);
 	if (IS_ERR(attach)) {
 		err = -EINVAL;
-		goto fail_attach;
+		goto put;
 	}
 	sgt = dma_buf_map_attachment(attach, DMA_BIDIRECTIONAL);
 	if (IS_ERR(sgt)) {
@@ -400,7 +523,7 @@ int al5_dmabuf_get_address(struct device *dev, u32 fd, u32 *bus_address)
 	dma_buf_unmap_attachment(attach, sgt, DMA_BIDIRECTIONAL);
 fail_map:
 	dma_buf_detach(dbuf, attach);
-fail_attach:
+put:
 	dma_buf_put(dbuf);
 	return err;
 }
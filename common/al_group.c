@@ -18,80 +18,167 @@
 #include <linux/slab.h>
 #include <linux/printk.h>
 #include <linux/string.h>
+#include <linux/rcupdate.h>
+#include <linux/idr.h>
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>
 
 #include "al_group.h"
 #include "al_mail.h"
 #include "al_codec_mails.h"
 
-void al5_group_init(struct al5_group *group, struct mcu_mailbox_interface *mcu,
-		    int max_users_nb, struct device *device)
+static unsigned int drain_budget = 100;
+module_param(drain_budget, uint, 0644);
+MODULE_PARM_DESC(drain_budget,
+		 "Mails delivered per mailbox drain, grows up to 8 times this value under backlog");
+
+#define MAX_BUDGET_FACTOR 8
+
+static bool print_mcu_traces;
+module_param(print_mcu_traces, bool, 0644);
+MODULE_PARM_DESC(print_mcu_traces,
+		 "Also print the mcu traces in the kernel log");
+
+/* power of 2, bytes */
+#define MCU_TRACES_SIZE (64 * 1024)
+
+static void drain_work(struct work_struct *work)
+{
+	struct al5_group *group = container_of(work, struct al5_group,
+					       drain_work);
+
+	al5_group_read_mails(group);
+	al5_mcu_flush(group->mcu);
+}
+
+int al5_group_init(struct al5_group *group, struct mcu_mailbox_interface *mcu,
+		   int max_users_nb, struct device *device)
 {
-	group->users = kcalloc(max_users_nb, sizeof(void *), GFP_KERNEL);
+	int err;
+
+	if (max_users_nb <= 0)
+		return -EINVAL;
+
+	err = kfifo_alloc(&group->traces, MCU_TRACES_SIZE, GFP_KERNEL);
+	if (err)
+		return err;
+	mutex_init(&group->traces_read_lock);
+	atomic_set(&group->traces_dropped, 0);
+	group->trace_filter[0] = '\0';
+	spin_lock_init(&group->trace_filter_lock);
+
+	idr_init(&group->users);
 	group->max_users_nb = max_users_nb;
+	memset(group->chans, 0, sizeof(group->chans));
 	spin_lock_init(&group->lock);
 	group->mcu = mcu;
 	group->device = device;
+	group->drain_budget = drain_budget;
+	INIT_WORK(&group->drain_work, drain_work);
+	atomic_set(&group->drains, 0);
+	atomic_set(&group->drained_mails, 0);
+	atomic_set(&group->budget_exhausted, 0);
+	atomic_set(&group->rescheduled, 0);
+
+	return 0;
 }
 
 void al5_user_destroy_channel_resources(struct al5_user *user);
 void al5_group_deinit(struct al5_group *group)
 {
-	kfree(group->users);
+	cancel_work_sync(&group->drain_work);
+	idr_destroy(&group->users);
+	kfifo_free(&group->traces);
 }
 
 int al5_group_bind_user(struct al5_group *group, struct al5_user *user)
 {
-	unsigned long flags = 0;
-	int uid = -1;
-	int err = 0;
-	int i;
+	int uid;
 
-	spin_lock_irqsave(&group->lock, flags);
-	for (i = 0; i < group->max_users_nb; ++i) {
-		if (group->users[i] == NULL) {
-			uid = i;
-			break;
-		}
-	}
-	if (uid == -1) {
+	/* the uid is reserved first, the user is only visible once ready */
+	idr_preload(GFP_KERNEL);
+	spin_lock(&group->lock);
+	uid = idr_alloc(&group->users, NULL, 0,
+			READ_ONCE(group->max_users_nb), GFP_NOWAIT);
+	spin_unlock(&group->lock);
+	idr_preload_end();
+
+	if (uid == -ENOSPC) {
 		dev_err(group->device, "Max user allocation reached\n");
-		err = -EAGAIN;
-		goto unlock;
+		return -EAGAIN;
 	}
+	if (uid < 0)
+		return uid;
 
-	group->users[uid] = user;
 	al5_user_init(user, uid, group->mcu, group->device);
 
-unlock:
-	spin_unlock_irqrestore(&group->lock, flags);
-	return err;
+	spin_lock(&group->lock);
+	idr_replace(&group->users, user, uid);
+	spin_unlock(&group->lock);
 
+	return 0;
 }
 EXPORT_SYMBOL_GPL(al5_group_bind_user);
 
+/* idr takes an end of 0 or below as no limit at all */
+int al5_group_set_max_users(struct al5_group *group, u32 max_users_nb)
+{
+	if (max_users_nb == 0)
+		return -EINVAL;
+
+	WRITE_ONCE(group->max_users_nb, min_t(u32, max_users_nb, INT_MAX));
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_group_set_max_users);
+
 void al5_group_unbind_user(struct al5_group *group, struct al5_user *user)
 {
-	unsigned long flags = 0;
+	int i;
+
+	spin_lock(&group->lock);
+	idr_remove(&group->users, user->uid);
+	/* the channel may have been destroyed without clearing its entry */
+	for (i = 0; i < AL5_CHAN_UID_NUMBER; ++i)
+		if (rcu_access_pointer(group->chans[i]) == user)
+			RCU_INIT_POINTER(group->chans[i], NULL);
+	spin_unlock(&group->lock);
 
-	spin_lock_irqsave(&group->lock, flags);
-	group->users[user->uid] = NULL;
-	spin_unlock_irqrestore(&group->lock, flags);
+	/* wait for the irq thread to be done with the user */
+	synchronize_rcu();
 }
 EXPORT_SYMBOL_GPL(al5_group_unbind_user);
 
-struct al5_user *al5_group_user_from_uid(struct al5_group *group, int user_uid)
+/* The mcu is being restarted, the users lose their channel */
+void al5_group_reset_users(struct al5_group *group)
 {
 	struct al5_user *user;
+	int uid, i;
+
+	spin_lock(&group->lock);
+	/*
+	 * the users without a channel have nothing to lose, the commands they
+	 * have in flight are failed by the change of mcu generation
+	 */
+	idr_for_each_entry(&group->users, user, uid)
+		if (user && al5_chan_is_created(user))
+			al5_user_reset(user);
+	for (i = 0; i < AL5_CHAN_UID_NUMBER; ++i)
+		RCU_INIT_POINTER(group->chans[i], NULL);
+	spin_unlock(&group->lock);
+
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(al5_group_reset_users);
 
-	if (user_uid >= group->max_users_nb || user_uid < 0) {
-		dev_err(group->device,
-			"Received user id %d, expected a value in [0..%ld]\n",
-			user_uid, (unsigned long)group->max_users_nb);
-		user = NULL;
-	} else
-		user = group->users[user_uid];
+struct al5_user *al5_group_user_from_uid(struct al5_group *group, int user_uid)
+{
+	if (user_uid < 0) {
+		dev_err(group->device, "Received user id %d\n", user_uid);
+		return NULL;
+	}
 
-	return user;
+	return idr_find(&group->users, user_uid);
 }
 EXPORT_SYMBOL_GPL(al5_group_user_from_uid);
 
@@ -103,11 +190,14 @@ static bool hasChannelId(struct al5_user *user, int channel_id)
 struct al5_user *al5_group_user_from_chan_uid(struct al5_group *group,
 					      int chan_uid)
 {
-	int i;
+	struct al5_user *user = NULL;
+
+	if (chan_uid >= 0 && chan_uid < AL5_CHAN_UID_NUMBER)
+		user = rcu_dereference(group->chans[chan_uid]);
 
-	for (i = 0; i < group->max_users_nb; ++i)
-		if (hasChannelId(group->users[i], chan_uid))
-			return group->users[i];
+	/* the entry is only trusted if the user still has this channel */
+	if (hasChannelId(user, chan_uid))
+		return user;
 
 	dev_err(group->device, "Received chan_uid %d. No corresponding channel",
 		chan_uid);
@@ -120,21 +210,22 @@ static void destroy_orphan_channel(struct al5_group *group, int chan_uid)
 {
 	int err;
 	struct al5_mail *mail;
+	u32 body = chan_uid;
 
-	mail = create_quiet_destroy_channel_msg(chan_uid);
+	/* called from the mailbox drain, which can't sleep */
+	mail = al5_mail_create_atomic(AL_MCU_MSG_QUIET_DESTROY_CHANNEL,
+				      sizeof(body));
 	if (!mail)
 		goto fail;
+	memcpy(al5_mail_get_body(mail), &body, sizeof(body));
 
-	err = al5_mcu_send(group->mcu, mail);
+	/* we are in the irq thread, which is the one flushing the mcu */
+	err = al5_mcu_submit(group->mcu, &mail, 1, true);
 	if (err)
-		goto fail_send;
+		goto fail;
 
-	al5_signal_mcu(group->mcu);
-	al5_free_mail(mail);
 	return;
 
-fail_send:
-	al5_free_mail(mail);
 fail:
 	dev_err(group->device, "Couldn't destroy orphan mcu channel\n");
 }
@@ -157,6 +248,16 @@ bool should_destroy_channel_on_bad_feedback(u32 mail_uid)
 	}
 }
 
+/* don't bind a channel to a user being unbound */
+static void bind_channel(struct al5_group *group, int chan_uid,
+			 struct al5_user *user)
+{
+	spin_lock(&group->lock);
+	if (idr_find(&group->users, user->uid) == user)
+		rcu_assign_pointer(group->chans[chan_uid], user);
+	spin_unlock(&group->lock);
+}
+
 struct al5_user *retrieve_user(struct al5_group *group, struct al5_mail *mail)
 {
 	struct al5_user *user;
@@ -167,6 +268,9 @@ struct al5_user *retrieve_user(struct al5_group *group, struct al5_mail *mail)
 	case AL_MCU_MSG_CREATE_CHANNEL:
 		user_uid = al5_mail_get_word(mail, 1);
 		user = al5_group_user_from_uid(group, user_uid);
+		chan_uid = al5_mail_get_chan_uid(mail);
+		if (user && chan_uid >= 0 && chan_uid < BAD_CHAN)
+			bind_channel(group, chan_uid, user);
 		break;
 	case AL_MCU_MSG_INIT:
 	case AL_MCU_MSG_SEARCH_START_CODE:
@@ -194,18 +298,80 @@ int try_to_deliver_to_user(struct al5_group *group, struct al5_mail *mail)
 	return 0;
 }
 
+static bool trace_is_filtered(struct al5_group *group, const char *trace,
+			      size_t len)
+{
+	bool filtered;
+
+	spin_lock(&group->trace_filter_lock);
+	filtered = group->trace_filter[0] &&
+		   !strnstr(trace, group->trace_filter, len);
+	spin_unlock(&group->trace_filter_lock);
+
+	return filtered;
+}
+
+/*
+ * Only the mailbox drain writes traces, under the mcu read lock, so the fifo
+ * needs no lock on this side. A trace that doesn't fit is dropped whole.
+ */
+static void store_mcu_trace(struct al5_group *group, struct al5_mail *mail)
+{
+	char *trace = al5_mail_get_body(mail);
+	size_t len = strnlen(trace, al5_mail_get_size(mail));
+
+	if (READ_ONCE(print_mcu_traces))
+		al5_print_mcu_trace(mail);
+
+	if (!len || trace_is_filtered(group, trace, len))
+		return;
+
+	if (kfifo_avail(&group->traces) < len + 1) {
+		atomic_inc(&group->traces_dropped);
+		return;
+	}
+
+	kfifo_in(&group->traces, trace, len);
+	kfifo_in(&group->traces, "\n", 1);
+}
+
+ssize_t al5_group_read_traces(struct al5_group *group, char __user *buf,
+			      size_t count)
+{
+	unsigned int copied;
+	int err;
+
+	if (mutex_lock_interruptible(&group->traces_read_lock))
+		return -EINTR;
+	err = kfifo_to_user(&group->traces, buf, count, &copied);
+	mutex_unlock(&group->traces_read_lock);
+
+	return err ? err : copied;
+}
+EXPORT_SYMBOL_GPL(al5_group_read_traces);
+
+void al5_group_set_trace_filter(struct al5_group *group, const char *filter)
+{
+	spin_lock(&group->trace_filter_lock);
+	strlcpy(group->trace_filter, filter, sizeof(group->trace_filter));
+	spin_unlock(&group->trace_filter_lock);
+}
+EXPORT_SYMBOL_GPL(al5_group_set_trace_filter);
+
 void handle_mail(struct al5_group *group, struct al5_mail *mail)
 {
 	int error;
 	u32 mail_uid = al5_mail_get_uid(mail);
 
 	if (mail_uid == AL_MCU_MSG_TRACE) {
-		al5_print_mcu_trace(mail);
+		store_mcu_trace(group, mail);
 		al5_free_mail(mail);
 		return;
 	}
 
+	rcu_read_lock();
 	error = try_to_deliver_to_user(group, mail);
+	rcu_read_unlock();
 	if (error) {
 		if (should_destroy_channel_on_bad_feedback(mail_uid))
 			destroy_orphan_channel(group, al5_mail_get_chan_uid(mail));
@@ -213,18 +379,64 @@ void handle_mail(struct al5_group *group, struct al5_mail *mail)
 	}
 }
 
-void read_mail(struct al5_group *group)
+static void read_mail(struct al5_mail *mail, void *data)
 {
-	struct al5_mail *mail = al5_mcu_recv(group->mcu);
+	struct al5_group *group = data;
+
+	if (!mail) {
+		dev_warn_ratelimited(group->device,
+				     "No mail available, dropped mcu message\n");
+		return;
+	}
 
 	handle_mail(group, mail);
 }
 
-#define MAX_MAILBOX_MSG 100
+/*
+ * Drain at most drain_budget mails. If mails are still there afterwards,
+ * the budget grows and the drain goes on from a work item rather than
+ * waiting for the next mcu interrupt. It shrinks back once the backlog is
+ * gone.
+ */
 void al5_group_read_mails(struct al5_group *group)
 {
-	unsigned nb_msg = 0;
+	int min_budget = max_t(int, READ_ONCE(drain_budget), 1);
+	int max_budget = min_budget * MAX_BUDGET_FACTOR;
+	int budget = clamp(READ_ONCE(group->drain_budget), min_budget,
+			   max_budget);
+	int nb_msg = 0;
+	int nb_read;
+
+	/* each pass reads head and tail once, until the mailbox is empty */
+	do {
+		nb_read = al5_mcu_recv_batch(group->mcu, budget - nb_msg,
+					     read_mail, group);
+		nb_msg += nb_read;
+	} while (nb_read && nb_msg < budget);
+
+	atomic_inc(&group->drains);
+	atomic_add(nb_msg, &group->drained_mails);
+
+	if (nb_msg == budget && !al5_mcu_is_empty(group->mcu)) {
+		atomic_inc(&group->budget_exhausted);
+		WRITE_ONCE(group->drain_budget, min(budget * 2, max_budget));
+		if (queue_work(system_highpri_wq, &group->drain_work))
+			atomic_inc(&group->rescheduled);
+	} else if (nb_msg < budget / 4) {
+		WRITE_ONCE(group->drain_budget, max(budget / 2, min_budget));
+	}
+}
 
-	while (!al5_mcu_is_empty(group->mcu) && nb_msg++ < MAX_MAILBOX_MSG)
-		read_mail(group);
+int al5_group_drain_show(struct seq_file *m, void *unused)
+{
+	struct al5_group *group = m->private;
+
+	seq_printf(m, "budget: %d\n", READ_ONCE(group->drain_budget));
+	seq_printf(m, "drains: %d\n", atomic_read(&group->drains));
+	seq_printf(m, "mails: %d\n", atomic_read(&group->drained_mails));
+	seq_printf(m, "budget exhausted: %d\n",
+		   atomic_read(&group->budget_exhausted));
+	seq_printf(m, "rescheduled: %d\n", atomic_read(&group->rescheduled));
+
+	return 0;
 }
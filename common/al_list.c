@@ -17,58 +17,48 @@
  */
 
 #include "al_list.h"
-#include <linux/slab.h>
+#include "al_mail_private.h"
 
-void al5_list_init(struct al5_list **l)
+void al5_list_init(struct al5_list *l)
 {
-	*l = NULL;
+	INIT_LIST_HEAD(&l->head);
+	l->nb = 0;
 }
 
 int al5_list_empty(const struct al5_list *l)
 {
-	return l == NULL;
+	return list_empty(&l->head);
 }
 
-void al5_list_push(struct al5_list **l, struct al5_mail *mail)
+unsigned int al5_list_size(const struct al5_list *l)
 {
-	struct al5_list *first_pos = *l;
+	return l->nb;
+}
 
-	if (*l == NULL) {
-		*l = kmalloc(sizeof(**l), GFP_KERNEL);
-		(*l)->mail = mail;
-		(*l)->next = NULL;
-		return;
-	}
-	while ((*l)->next != NULL)
-		*l = (*l)->next;
-	(*l)->next = kmalloc(sizeof(*((*l)->next)), GFP_KERNEL);
-	(*l)->next->mail = mail;
-	(*l)->next->next = NULL;
-	*l = first_pos;
+void al5_list_push(struct al5_list *l, struct al5_mail *mail)
+{
+	list_add_tail(&mail->list, &l->head);
+	++l->nb;
 }
 
-struct al5_mail *al5_list_pop(struct al5_list **l)
+struct al5_mail *al5_list_pop(struct al5_list *l)
 {
 	struct al5_mail *mail;
-	struct al5_list *next;
 
-	if (*l == NULL)
-		return NULL;
-
-	mail = (*l)->mail;
-	next = (*l)->next;
+	mail = list_first_entry_or_null(&l->head, struct al5_mail, list);
+	if (mail) {
+		list_del(&mail->list);
+		--l->nb;
+	}
 
-	kfree(*l);
-	*l = next;
 	return mail;
 }
 
-void al5_list_empty_and_destroy(struct al5_list **l)
+void al5_list_empty_and_destroy(struct al5_list *l)
 {
-	while (!al5_list_empty(*l)) {
+	while (!al5_list_empty(l)) {
 		struct al5_mail *mail = al5_list_pop(l);
 
 		al5_free_mail(mail);
 	}
-	kfree(*l);
 }
@@ -18,27 +18,189 @@
 
 #include <linux/slab.h>
 #include <linux/string.h>
+#include <linux/seq_file.h>
 
 #include "al_mail.h"
 #include "al_mail_private.h"
 
-struct al5_mail *al5_mail_create(u32 msg_uid, u32 content_size)
-{
-	/* body should be aligned 32 bits */
-	const size_t mail_size = roundup(sizeof(struct al5_mail), 4);
-	struct al5_mail *mail = kmalloc(mail_size + content_size, GFP_KERNEL);
+/* body should be aligned 32 bits */
+#define MAIL_HEADER_SIZE roundup(sizeof(struct al5_mail), 4)
 
-	if (!mail)
-		return NULL;
+#define AL5_MAIL_CLASSES 5
+
+/*
+ * Biggest body of each size class: empty and stream buffer mails, feedbacks,
+ * channel creations, encode/decode requests and a full mailbox.
+ */
+static const u32 mail_class_sizes[AL5_MAIL_CLASSES] = {
+	32, 128, 576, 1040, 2048
+};
+/* mails kept aside so the receive path doesn't fail under memory pressure */
+static const int mail_class_reserve[AL5_MAIL_CLASSES] = {
+	64, 32, 16, 8, 4
+};
+static const char * const mail_class_names[AL5_MAIL_CLASSES] = {
+	"al5_mail_32", "al5_mail_128", "al5_mail_576", "al5_mail_1040",
+	"al5_mail_2048"
+};
+
+struct mail_class {
+	struct kmem_cache *cache;
+	mempool_t *reserve;
+	atomic_t hits;
+	atomic_t reserve_hits;
+	atomic_t failures;
+};
+
+static struct mail_class mail_classes[AL5_MAIL_CLASSES];
+/* mails too big for any class, allocated with kmalloc */
+static atomic_t mail_oversize;
+
+static void mail_init(struct al5_mail *mail, u32 msg_uid, u32 content_size)
+{
 	mail->body_offset = 0;
 	mail->msg_uid = msg_uid;
 	mail->body_size = content_size;
-	mail->body = (u8 *)mail + mail_size;
+	mail->body = (u8 *)mail + MAIL_HEADER_SIZE;
+	mail->pool = NULL;
+}
+
+static int mail_class_of(u32 content_size)
+{
+	int i;
+
+	for (i = 0; i < AL5_MAIL_CLASSES; ++i)
+		if (content_size <= mail_class_sizes[i])
+			return i;
+
+	return -1;
+}
+
+struct al5_mail *al5_mail_create(u32 msg_uid, u32 content_size)
+{
+	int class = mail_class_of(content_size);
+	struct al5_mail *mail;
+
+	if (class < 0) {
+		atomic_inc(&mail_oversize);
+		mail = kmalloc(MAIL_HEADER_SIZE + content_size, GFP_KERNEL);
+		if (!mail)
+			return NULL;
+		mail_init(mail, msg_uid, content_size);
+		return mail;
+	}
+
+	mail = kmem_cache_alloc(mail_classes[class].cache, GFP_KERNEL);
+	if (!mail) {
+		atomic_inc(&mail_classes[class].failures);
+		return NULL;
+	}
+	atomic_inc(&mail_classes[class].hits);
+	mail_init(mail, msg_uid, content_size);
+	mail->pool = mail_classes[class].reserve;
 
 	return mail;
 }
 EXPORT_SYMBOL_GPL(al5_mail_create);
 
+/*
+ * Never sleeps: the mail is taken from the smallest class that fits and
+ * falls back on the class reserve when the allocator can't serve us.
+ * The body is meant to be filled in place by the caller.
+ */
+struct al5_mail *al5_mail_create_atomic(u32 msg_uid, u32 content_size)
+{
+	int class = mail_class_of(content_size);
+	struct mail_class *mc;
+	struct al5_mail *mail;
+
+	if (class < 0) {
+		atomic_inc(&mail_oversize);
+		return NULL;
+	}
+	mc = &mail_classes[class];
+
+	mail = kmem_cache_alloc(mc->cache, GFP_ATOMIC | __GFP_NOWARN);
+	if (mail) {
+		atomic_inc(&mc->hits);
+	} else {
+		mail = mempool_alloc(mc->reserve, GFP_ATOMIC);
+		if (!mail) {
+			atomic_inc(&mc->failures);
+			return NULL;
+		}
+		atomic_inc(&mc->reserve_hits);
+	}
+	mail_init(mail, msg_uid, content_size);
+	mail->body_offset = content_size;
+	mail->pool = mc->reserve;
+
+	return mail;
+}
+EXPORT_SYMBOL_GPL(al5_mail_create_atomic);
+
+int al5_mail_caches_init(void)
+{
+	int i;
+
+	for (i = 0; i < AL5_MAIL_CLASSES; ++i) {
+		struct mail_class *mc = &mail_classes[i];
+
+		mc->cache = kmem_cache_create(mail_class_names[i],
+					      MAIL_HEADER_SIZE +
+					      mail_class_sizes[i],
+					      0, SLAB_HWCACHE_ALIGN, NULL);
+		if (!mc->cache)
+			goto fail;
+
+		mc->reserve = mempool_create_slab_pool(mail_class_reserve[i],
+						       mc->cache);
+		if (!mc->reserve)
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	al5_mail_caches_deinit();
+	return -ENOMEM;
+}
+
+void al5_mail_caches_deinit(void)
+{
+	int i;
+
+	for (i = 0; i < AL5_MAIL_CLASSES; ++i) {
+		struct mail_class *mc = &mail_classes[i];
+
+		if (mc->reserve)
+			mempool_destroy(mc->reserve);
+		if (mc->cache)
+			kmem_cache_destroy(mc->cache);
+		mc->reserve = NULL;
+		mc->cache = NULL;
+	}
+}
+
+int al5_mail_caches_show(struct seq_file *m, void *unused)
+{
+	int i;
+
+	seq_printf(m, "%-8s %10s %10s %10s\n",
+		   "body", "hits", "reserve", "failures");
+	for (i = 0; i < AL5_MAIL_CLASSES; ++i) {
+		struct mail_class *mc = &mail_classes[i];
+
+		seq_printf(m, "%-8u %10d %10d %10d\n", mail_class_sizes[i],
+			   atomic_read(&mc->hits),
+			   atomic_read(&mc->reserve_hits),
+			   atomic_read(&mc->failures));
+	}
+	seq_printf(m, "oversize %d\n", atomic_read(&mail_oversize));
+
+	return 0;
+}
+
 void al5_mail_write(struct al5_mail *mail, void *content, u32 size)
 {
 	memcpy(mail->body + mail->body_offset, content, size);
@@ -54,7 +216,13 @@ EXPORT_SYMBOL_GPL(al5_mail_write_word);
 
 void al5_free_mail(struct al5_mail *mail)
 {
-	if (mail != NULL)
+	if (mail == NULL)
+		return;
+
+	/* class mails all go through the reserve, which refills itself first */
+	if (mail->pool)
+		mempool_free(mail, mail->pool);
+	else
 		kfree(mail);
 }
 EXPORT_SYMBOL_GPL(al5_free_mail);
@@ -40,6 +40,11 @@ static int mailbox_is_wrapping(size_t mailbox_size,
 {
 	return tail_value + data_size > mailbox_size;
 }
+
+static u32 next_offset(struct mailbox *box, u32 offset, size_t size)
+{
+	return ((offset + size + 3) / 4 * 4) % box->size;
+}
 /* Require mailbox_is_wrapping */
 static void write_in_mailbox_until_wrap(struct mailbox *box,
 					size_t *memcpy_size,
@@ -75,19 +80,27 @@ void al5_mailbox_init(struct mailbox *box, void *base, size_t data_size)
 	box->head = base;
 	box->tail = base + 4;
 	box->data = base + 8;
+	al5_mailbox_reset(box);
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_init);
+
+/* Empty the mailbox, the mcu must not be running */
+void al5_mailbox_reset(struct mailbox *box)
+{
 	iowrite32(0, box->head);
 	iowrite32(0, box->tail);
+	box->local_tail = 0;
 }
-EXPORT_SYMBOL_GPL(al5_mailbox_init);
+EXPORT_SYMBOL_GPL(al5_mailbox_reset);
 
-static u16 unserialize_msg_uid(u8 *header)
+static u16 unserialize_msg_uid(u32 header)
 {
-	return header[2] + (header[3] << 8);
+	return header >> 16;
 }
 
-static u16 unserialize_body_size(u8 *header)
+static u16 unserialize_body_size(u32 header)
 {
-	return header[0] + (header[1] << 8);
+	return header & 0xffff;
 }
 
 static void serialize_header(u8 *header, u16 msg_uid, u16 body_size)
@@ -98,14 +111,18 @@ static void serialize_header(u8 *header, u16 msg_uid, u16 body_size)
 	header[3] = msg_uid >> 8;
 }
 
-static void pull_tail(struct mailbox *box)
+/* the data is copied with relaxed accesses, it must land before the tail */
+static void push_tail(struct mailbox *box)
 {
-	box->local_tail = ioread32(box->tail);
+	wmb();
+	writel_relaxed(box->local_tail, box->tail);
 }
 
-static void push_tail(struct mailbox *box)
+/* the data must be read before the mcu can overwrite it */
+static void push_head(struct mailbox *box, u32 head_value)
 {
-	iowrite32(box->local_tail, box->tail);
+	mb();
+	writel_relaxed(head_value, box->head);
 }
 
 /* Assume there is enough place in mailbox */
@@ -120,67 +137,163 @@ static void write_data(struct mailbox *box, u8 *in_data, size_t size)
 					    &in_data);
 	memcpy_toio_32(box->data + tail_value, in_data, size);
 
-	tail_value = ((tail_value + size + 3) / 4 * 4) % box->size;
-	box->local_tail = tail_value;
+	box->local_tail = next_offset(box, tail_value, size);
 }
 
-static u8 *read_data(struct mailbox *box, size_t size)
+/* Copy size bytes starting at head, rounded up to the 32 bits ring words */
+static void read_data(struct mailbox *box, u32 head_value, u8 *out_data,
+		      size_t size)
 {
-	u8 *out_data = kzalloc(size, GFP_KERNEL);
-	u32 head_value = ioread32(box->head);
-	u8 *data_iterator = out_data;
-
+	size = roundup(size, 4);
 	if (mailbox_is_wrapping(box->size, head_value, size))
-		read_in_mailbox_until_wrap(box, &size, &head_value,
-					   &data_iterator);
-	memcpy_fromio_32(data_iterator, box->data + head_value, size);
-
-	head_value = ((head_value + size + 3) / 4 * 4) % box->size;
-	iowrite32(head_value, box->head);
+		read_in_mailbox_until_wrap(box, &size, &head_value, &out_data);
+	memcpy_fromio_32(out_data, box->data + head_value, size);
+}
 
-	return out_data;
+static size_t mail_size_in_mailbox(struct al5_mail *mail)
+{
+	return header_size + roundup(al5_mail_get_size(mail), 4);
 }
 
-int al5_mailbox_write(struct mailbox *box, struct al5_mail *mail)
+static void write_mail(struct mailbox *box, struct al5_mail *mail)
 {
 	u8 header[header_size];
 	size_t mail_size = al5_mail_get_size(mail);
-	size_t total_size = mail_size + header_size;
+
+	serialize_header(header, al5_mail_get_uid(mail), mail_size);
+	write_data(box, header, header_size);
+	write_data(box, al5_mail_get_body(mail), mail_size);
+}
+
+/* Bytes taken in the mailbox by the mail, header included */
+size_t al5_mailbox_mail_size(struct al5_mail *mail)
+{
+	return mail_size_in_mailbox(mail);
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_mail_size);
+
+/* Bytes of mails that fit in the mailbox when it is empty */
+size_t al5_mailbox_capacity(struct mailbox *box)
+{
+	return box->size - 4;
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_capacity);
+
+/* false if the mail is too big to ever be written in the mailbox */
+bool al5_mailbox_can_hold(struct mailbox *box, struct al5_mail *mail)
+{
+	return mail_size_in_mailbox(mail) <= al5_mailbox_capacity(box);
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_can_hold);
+
+/*
+ * Write the first mails, as many as there is room for. The tail is only
+ * published once, after the last one. Returns the number of mails written.
+ */
+int al5_mailbox_write_batch(struct mailbox *box, struct al5_mail **mails,
+			    int nb_mails)
+{
+	size_t total_size = 0;
 	unsigned int head_value = ioread32(box->head);
 	unsigned int tail_value = ioread32(box->tail);
 	size_t mailbox_size = box->size;
 	size_t used_size =
 		(tail_value >= head_value) ? (tail_value - head_value)
 		: (mailbox_size + tail_value - head_value);
+	int nb_written;
+	int i;
 
-	if (not_enough_space_in_mailbox(mailbox_size, used_size, total_size))
-		return -EAGAIN;
+	for (nb_written = 0; nb_written < nb_mails; ++nb_written) {
+		size_t size = mail_size_in_mailbox(mails[nb_written]);
 
-	serialize_header(header, al5_mail_get_uid(mail), mail_size);
+		if (not_enough_space_in_mailbox(mailbox_size, used_size,
+						total_size + size))
+			break;
+		total_size += size;
+	}
 
-	pull_tail(box);
-	write_data(box, header, header_size);
-	write_data(box, al5_mail_get_body(mail), mail_size);
+	if (!nb_written)
+		return 0;
+
+	box->local_tail = tail_value;
+	for (i = 0; i < nb_written; ++i)
+		write_mail(box, mails[i]);
 	push_tail(box);
 
-	return 0;
+	return nb_written;
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_write_batch);
+
+int al5_mailbox_write(struct mailbox *box, struct al5_mail *mail)
+{
+	return al5_mailbox_write_batch(box, &mail, 1) == 1 ? 0 : -EAGAIN;
 }
 EXPORT_SYMBOL_GPL(al5_mailbox_write);
 
-struct al5_mail *al5_mailbox_read(struct mailbox *box)
+/*
+ * The header is peeked in place and the body is copied once, straight from
+ * the ring into a mail from the size class caches. If no mail can be taken,
+ * the message is skipped and NULL is returned. *head is moved past the
+ * message.
+ */
+static struct al5_mail *read_mail(struct mailbox *box, u32 *head)
 {
-	u8 *header = read_data(box, header_size);
+	u32 header = readl_relaxed(box->data + *head);
 	u16 msg_uid = unserialize_msg_uid(header);
 	u16 body_size = unserialize_body_size(header);
-	struct al5_mail *mail = al5_mail_create(msg_uid, body_size);
+	struct al5_mail *mail = al5_mail_create_atomic(msg_uid, body_size);
+
+	*head = next_offset(box, *head, header_size);
+	if (mail)
+		read_data(box, *head, al5_mail_get_body(mail), body_size);
+	*head = next_offset(box, *head, body_size);
 
-	u8 *body = read_data(box, body_size);
+	return mail;
+}
 
-	al5_mail_write(mail, body, body_size);
+struct al5_mail *al5_mailbox_read(struct mailbox *box)
+{
+	u32 head_value = ioread32(box->head);
+	struct al5_mail *mail = read_mail(box, &head_value);
 
-	kfree(header);
-	kfree(body);
+	push_head(box, head_value);
 
 	return mail;
 }
 EXPORT_SYMBOL_GPL(al5_mailbox_read);
+
+/*
+ * Head and tail are only read once: every message present in the mailbox
+ * at that time is parsed from a local cursor, up to budget messages.
+ * The head is given back to the mcu at the end, or as soon as watermark
+ * bytes were consumed if watermark isn't 0.
+ * handle is called for each message, with a NULL mail if it was dropped.
+ */
+int al5_mailbox_read_batch(struct mailbox *box, int budget, size_t watermark,
+			   al5_mail_handler handle, void *data)
+{
+	u32 head_value = ioread32(box->head);
+	u32 tail_value = ioread32(box->tail);
+	u32 published_head = head_value;
+	int nb_mails = 0;
+
+	while (head_value != tail_value && nb_mails < budget) {
+		struct al5_mail *mail = read_mail(box, &head_value);
+		size_t consumed = (head_value + box->size - published_head) %
+				  box->size;
+
+		if (watermark && consumed >= watermark) {
+			push_head(box, head_value);
+			published_head = head_value;
+		}
+
+		handle(mail, data);
+		++nb_mails;
+	}
+
+	if (published_head != head_value)
+		push_head(box, head_value);
+
+	return nb_mails;
+}
+EXPORT_SYMBOL_GPL(al5_mailbox_read_batch);
@@ -0,0 +1,92 @@
+/*
+ * al_module.c init and exit of the allegro common module: state shared by
+ * all the codec devices
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "al_module.h"
+#include "al_mail.h"
+#include "al_bench.h"
+
+static struct dentry *debugfs_root;
+
+struct dentry *al5_debugfs_root(void)
+{
+	return debugfs_root;
+}
+EXPORT_SYMBOL_GPL(al5_debugfs_root);
+
+static int mail_caches_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, al5_mail_caches_show, inode->i_private);
+}
+
+static const struct file_operations mail_caches_fops = {
+	.owner = THIS_MODULE,
+	.open = mail_caches_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int copy_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, al5_bench_copy_show, inode->i_private);
+}
+
+static const struct file_operations copy_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = copy_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init al5_module_init(void)
+{
+	int err;
+
+	err = al5_mail_caches_init();
+	if (err)
+		return err;
+
+	/* debugfs is only used for statistics, don't fail without it */
+	debugfs_root = debugfs_create_dir("allegro", NULL);
+	if (IS_ERR_OR_NULL(debugfs_root)) {
+		debugfs_root = NULL;
+		return 0;
+	}
+
+	debugfs_create_file("mail_caches", 0444, debugfs_root, NULL,
+			    &mail_caches_fops);
+	debugfs_create_file("copy_bench", 0400, debugfs_root, NULL,
+			    &copy_bench_fops);
+
+	return 0;
+}
+
+static void __exit al5_module_exit(void)
+{
+	debugfs_remove_recursive(debugfs_root);
+	al5_mail_caches_deinit();
+}
+
+module_init(al5_module_init);
+module_exit(al5_module_exit);
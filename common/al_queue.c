@@ -29,7 +29,7 @@ EXPORT_SYMBOL_GPL(al5_queue_init);
 
 static bool mail_is_available(struct al5_queue *q)
 {
-	return !al5_list_empty(q->list) || !q->locked;
+	return !al5_list_empty(&q->list) || !q->locked;
 }
 
 int al5_queue_pop_timeout(struct al5_mail **mail, struct al5_queue *q)
@@ -81,6 +81,20 @@ struct al5_mail *al5_queue_pop(struct al5_queue *q)
 }
 EXPORT_SYMBOL_GPL(al5_queue_pop);
 
+/* Never waits, NULL if the queue is empty */
+struct al5_mail *al5_queue_try_pop(struct al5_queue *q)
+{
+	struct al5_mail *mail;
+	unsigned long flags = 0;
+
+	spin_lock_irqsave(&q->lock, flags);
+	mail = al5_list_pop(&q->list);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return mail;
+}
+EXPORT_SYMBOL_GPL(al5_queue_try_pop);
+
 void al5_queue_push(struct al5_queue *q, struct al5_mail *mail)
 {
 	unsigned long flags = 0;
@@ -93,6 +107,30 @@ void al5_queue_push(struct al5_queue *q, struct al5_mail *mail)
 }
 EXPORT_SYMBOL_GPL(al5_queue_push);
 
+/*
+ * Push the mail, dropping the oldest ones to keep at most max_mails in the
+ * queue. Returns true if a mail was dropped.
+ */
+bool al5_queue_push_bounded(struct al5_queue *q, struct al5_mail *mail,
+			    unsigned int max_mails)
+{
+	unsigned long flags = 0;
+	bool dropped = false;
+
+	spin_lock_irqsave(&q->lock, flags);
+	al5_list_push(&q->list, mail);
+	while (al5_list_size(&q->list) > max(max_mails, 1U)) {
+		al5_free_mail(al5_list_pop(&q->list));
+		dropped = true;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	wake_up_interruptible(&q->queue);
+
+	return dropped;
+}
+EXPORT_SYMBOL_GPL(al5_queue_push_bounded);
+
 void al5_queue_unlock(struct al5_queue *q)
 {
 	q->locked = false;
@@ -106,3 +144,17 @@ void al5_queue_lock(struct al5_queue *q)
 }
 EXPORT_SYMBOL_GPL(al5_queue_lock);
 
+bool al5_queue_is_empty(struct al5_queue *q)
+{
+	return al5_list_empty(&q->list);
+}
+EXPORT_SYMBOL_GPL(al5_queue_is_empty);
+
+/* Registers the poll waiter on the queue and tells if a mail is waiting */
+bool al5_queue_poll(struct al5_queue *q, struct file *filp, poll_table *wait)
+{
+	poll_wait(filp, &q->queue, wait);
+
+	return !al5_list_empty(&q->list);
+}
+EXPORT_SYMBOL_GPL(al5_queue_poll);
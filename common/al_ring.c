@@ -0,0 +1,137 @@
+/*
+ * al_ring.c rings of fixed size records shared with userspace
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+
+#include "al_ring.h"
+
+int al5_ring_init(struct al5_ring *ring, u32 nb_records, u32 record_size)
+{
+	if (!is_power_of_2(nb_records) || nb_records > AL5_RING_MAX_RECORDS)
+		return -EINVAL;
+
+	ring->size = PAGE_ALIGN(sizeof(*ring->header) +
+				(size_t)nb_records * record_size);
+	/* zeroed, so head and tail both start at 0 */
+	ring->header = vmalloc_user(ring->size);
+	if (!ring->header)
+		return -ENOMEM;
+
+	ring->records = (u8 *)ring->header + sizeof(*ring->header);
+	ring->nb_records = nb_records;
+	ring->record_size = record_size;
+	ring->head = 0;
+	ring->tail = 0;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(al5_ring_init);
+
+void al5_ring_deinit(struct al5_ring *ring)
+{
+	vfree(ring->header);
+	ring->header = NULL;
+}
+EXPORT_SYMBOL_GPL(al5_ring_deinit);
+
+int al5_ring_mmap(struct al5_ring *ring, struct vm_area_struct *vma)
+{
+	if (vma->vm_end - vma->vm_start > ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->header, 0);
+}
+EXPORT_SYMBOL_GPL(al5_ring_mmap);
+
+static void *ring_record(struct al5_ring *ring, u32 index)
+{
+	return ring->records +
+	       (index & (ring->nb_records - 1)) * ring->record_size;
+}
+
+/* the head is written by userspace, don't trust it further than this */
+static u32 ring_used(struct al5_ring *ring)
+{
+	u32 head = smp_load_acquire(&ring->header->head);
+
+	return min(ring->tail - head, ring->nb_records);
+}
+
+bool al5_ring_is_empty(struct al5_ring *ring)
+{
+	return ring_used(ring) == 0;
+}
+EXPORT_SYMBOL_GPL(al5_ring_is_empty);
+
+bool al5_ring_is_full(struct al5_ring *ring)
+{
+	return ring_used(ring) == ring->nb_records;
+}
+EXPORT_SYMBOL_GPL(al5_ring_is_full);
+
+/* Record to fill before calling al5_ring_produce(), NULL if the ring is full */
+void *al5_ring_next_slot(struct al5_ring *ring)
+{
+	if (al5_ring_is_full(ring))
+		return NULL;
+
+	return ring_record(ring, ring->tail);
+}
+EXPORT_SYMBOL_GPL(al5_ring_next_slot);
+
+void al5_ring_produce(struct al5_ring *ring)
+{
+	++ring->tail;
+	/* the record must be visible before the new tail */
+	smp_store_release(&ring->header->tail, ring->tail);
+}
+EXPORT_SYMBOL_GPL(al5_ring_produce);
+
+/* the tail is written by userspace, don't trust it further than this */
+static u32 ring_available(struct al5_ring *ring)
+{
+	u32 tail = smp_load_acquire(&ring->header->tail);
+
+	return min(tail - ring->head, ring->nb_records);
+}
+
+/*
+ * Copy the record offset records after the head, the record can't change
+ * under our feet once copied. Returns false if there is no such record.
+ */
+bool al5_ring_read(struct al5_ring *ring, u32 offset, void *record)
+{
+	if (offset >= ring_available(ring))
+		return false;
+
+	memcpy(record, ring_record(ring, ring->head + offset),
+	       ring->record_size);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(al5_ring_read);
+
+/* Give the nb_records oldest records back to userspace */
+void al5_ring_consume(struct al5_ring *ring, u32 nb_records)
+{
+	ring->head += nb_records;
+	smp_store_release(&ring->header->head, ring->head);
+}
+EXPORT_SYMBOL_GPL(al5_ring_consume);
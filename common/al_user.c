@@ -16,10 +16,18 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/moduleparam.h>
+#include <linux/uaccess.h>
 
 #include "al_user.h"
 #include "al_codec_mails.h"
 
+static unsigned int debug_queue_depth = 32;
+module_param(debug_queue_depth, uint, 0644);
+MODULE_PARM_DESC(debug_queue_depth,
+		 "Unread debug mails kept per user, the oldest ones are dropped");
+
 static int mail_to_queue(int mail_uid)
 {
 	switch (mail_uid) {
@@ -42,40 +50,345 @@ static int mail_to_queue(int mail_uid)
 	}
 }
 
-static int send_msg(struct mcu_mailbox_interface *mcu, struct al5_mail *mail)
+int al5_check_and_send_batch(struct al5_user *user, struct al5_mail **mails,
+			     int nb_mails)
 {
-	int err = al5_mcu_send(mcu, mail);
+	int err = 0;
+	int i;
 
-	if (err)
+	for (i = 0; i < nb_mails; ++i)
+		if (!mails[i])
+			err = -ENOMEM;
+
+	if (!err) {
+		user->mcu_generation = al5_mcu_generation(user->mcu);
+		return al5_mcu_submit(user->mcu, mails, nb_mails,
+				      user->nonblock);
+	}
+
+	for (i = 0; i < nb_mails; ++i)
+		al5_free_mail(mails[i]);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_check_and_send_batch);
+
+int al5_check_and_send(struct al5_user *user, struct al5_mail *mail)
+{
+	return al5_check_and_send_batch(user, &mail, 1);
+}
+EXPORT_SYMBOL_GPL(al5_check_and_send);
+
+void al5_user_deliver(struct al5_user *user, struct al5_mail *mail)
+{
+	int queue_id = mail_to_queue(al5_mail_get_uid(mail));
+
+	/* nothing makes userspace read the debug mails */
+	if (queue_id == AL5_USER_MAIL_DEBUG) {
+		if (al5_queue_push_bounded(&user->queues[queue_id], mail,
+					   READ_ONCE(debug_queue_depth)))
+			atomic_inc(&user->debug_dropped);
+		return;
+	}
+
+	al5_queue_push(&user->queues[queue_id], mail);
+
+	if (queue_id == AL5_USER_MAIL_STATUS && user->status_ring)
+		al5_user_refill_status_ring(user);
+}
+
+/* the status queue keeps what doesn't fit in the ring, in order */
+void al5_user_refill_status_ring(struct al5_user *user)
+{
+	struct al5_queue *queue = &user->queues[AL5_USER_MAIL_STATUS];
+	struct al5_status_record *record;
+	struct al5_mail *mail;
+	unsigned long flags;
+	int nb_moved = 0;
+
+	spin_lock_irqsave(&user->status_ring_lock, flags);
+	if (!user->status_ring)
+		goto unlock;
+
+	while ((record = al5_ring_next_slot(user->status_ring))) {
+		mail = al5_queue_try_pop(queue);
+		if (!mail)
+			break;
+
+		/* the body starts with the channel uid, drop truncated ones */
+		if (al5_mail_get_size(mail) < 4) {
+			al5_free_mail(mail);
+			continue;
+		}
+		record->size = min_t(u32, al5_mail_get_size(mail) - 4,
+				     sizeof(record->opaque));
+		memcpy(record->opaque, al5_mail_get_body(mail) + 4,
+		       record->size);
+		al5_ring_produce(user->status_ring);
+		al5_free_mail(mail);
+		++nb_moved;
+	}
+
+unlock:
+	spin_unlock_irqrestore(&user->status_ring_lock, flags);
+
+	/* pollers may have seen neither the mail nor the record */
+	if (nb_moved)
+		wake_up_interruptible(&queue->queue);
+}
+EXPORT_SYMBOL_GPL(al5_user_refill_status_ring);
+
+static struct al5_ring *create_ring(u32 nb_records, u32 record_size)
+{
+	struct al5_ring *ring;
+	int err;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return ERR_PTR(-ENOMEM);
+
+	err = al5_ring_init(ring, nb_records, record_size);
+	if (err) {
+		kfree(ring);
+		return ERR_PTR(err);
+	}
+
+	return ring;
+}
+
+static void destroy_ring(struct al5_ring *ring)
+{
+	al5_ring_deinit(ring);
+	kfree(ring);
+}
+
+int al5_user_setup_status_ring(struct al5_user *user,
+			       struct al5_ring_info *info)
+{
+	struct al5_ring *ring;
+	unsigned long flags;
+	int err = 0;
+
+	ring = create_ring(info->nb_records, sizeof(struct al5_status_record));
+	if (IS_ERR(ring))
+		return PTR_ERR(ring);
+
+	spin_lock_irqsave(&user->status_ring_lock, flags);
+	if (user->status_ring)
+		err = -EBUSY;
+	else
+		user->status_ring = ring;
+	spin_unlock_irqrestore(&user->status_ring_lock, flags);
+	if (err) {
+		destroy_ring(ring);
 		return err;
+	}
 
-	al5_signal_mcu(mcu);
+	info->record_size = ring->record_size;
+	info->mmap_offset = AL5_STATUS_RING_OFFSET;
+	info->mmap_size = ring->size;
+
+	/* statuses received before the ring was there come first */
+	al5_user_refill_status_ring(user);
 
 	return 0;
 }
+EXPORT_SYMBOL_GPL(al5_user_setup_status_ring);
 
-int al5_check_and_send(struct al5_user *user, struct al5_mail *mail)
+bool al5_user_status_is_ready(struct al5_user *user)
 {
+	struct al5_ring *ring = user->status_ring;
+
+	return ring && !al5_ring_is_empty(ring);
+}
+EXPORT_SYMBOL_GPL(al5_user_status_is_ready);
+
+/* the user must not receive mails anymore */
+void al5_user_release_rings(struct al5_user *user)
+{
+	if (user->status_ring) {
+		destroy_ring(user->status_ring);
+		user->status_ring = NULL;
+	}
+	if (user->submit_ring) {
+		destroy_ring(user->submit_ring);
+		user->submit_ring = NULL;
+	}
+}
+EXPORT_SYMBOL_GPL(al5_user_release_rings);
+
+int al5_user_register_buffers(struct al5_user *user, unsigned long arg)
+{
+	struct al5_buffer_registration reg;
+	struct al5_registered_buffer *buffers;
+	void __user *ubuffers;
+	size_t size;
 	int err;
 
-	if (!mail)
+	if (copy_from_user(&reg, (void *)arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.nb_buffers == 0 ||
+	    reg.nb_buffers > AL5_MAX_REGISTERED_BUFFERS || reg.reserved)
+		return -EINVAL;
+
+	size = reg.nb_buffers * sizeof(*buffers);
+	ubuffers = (void __user *)(uintptr_t)reg.buffers;
+	buffers = kmalloc(size, GFP_KERNEL);
+	if (!buffers)
 		return -ENOMEM;
-	err = send_msg(user->mcu, mail);
-	al5_free_mail(mail);
+	if (copy_from_user(buffers, ubuffers, size)) {
+		err = -EFAULT;
+		goto free;
+	}
+
+	err = al5_buffer_table_register(&user->buffer_table, buffers,
+					reg.nb_buffers);
 	if (err)
-		return err;
+		goto free;
+
+	if (copy_to_user(ubuffers, buffers, size)) {
+		al5_buffer_table_unregister(&user->buffer_table);
+		err = -EFAULT;
+	}
+
+free:
+	kfree(buffers);
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_user_register_buffers);
+
+/* the mcu may still use the buffers while the channel exists */
+int al5_user_unregister_buffers(struct al5_user *user)
+{
+	if (al5_chan_is_created(user))
+		return -EBUSY;
+
+	return al5_buffer_table_unregister(&user->buffer_table);
+}
+EXPORT_SYMBOL_GPL(al5_user_unregister_buffers);
+
+int al5_user_setup_submit_ring(struct al5_user *user,
+			       struct al5_ring_info *info, u32 record_size)
+{
+	struct al5_ring *ring;
+	int err;
+
+	ring = create_ring(info->nb_records, record_size);
+	if (IS_ERR(ring))
+		return PTR_ERR(ring);
+
+	err = mutex_lock_killable(&user->locks[AL5_USER_XCODE]);
+	if (err == -EINTR)
+		goto destroy_ring;
+
+	if (user->submit_ring) {
+		err = -EBUSY;
+		goto unlock;
+	}
+	WRITE_ONCE(user->submit_ring, ring);
+	mutex_unlock(&user->locks[AL5_USER_XCODE]);
+
+	info->record_size = ring->record_size;
+	info->mmap_offset = AL5_SUBMIT_RING_OFFSET;
+	info->mmap_size = ring->size;
 
 	return 0;
+
+unlock:
+	mutex_unlock(&user->locks[AL5_USER_XCODE]);
+destroy_ring:
+	destroy_ring(ring);
+	return err;
 }
-EXPORT_SYMBOL_GPL(al5_check_and_send);
+EXPORT_SYMBOL_GPL(al5_user_setup_submit_ring);
 
-void al5_user_deliver(struct al5_user *user, struct al5_mail *mail)
+/* mails built from the ring before they are sent */
+#define SUBMIT_BATCH_MAX 8
+
+/*
+ * Send the records of the submission ring, as many mails as fit in the
+ * mailbox with a single doorbell at a time. Records are only given back
+ * to userspace once sent. A wrong record stops the drain, it is dropped
+ * and reported once it comes first.
+ * Returns the number of records sent, or an error if none were.
+ */
+int al5_user_drain_submit_ring(struct al5_user *user,
+			       al5_record_to_mail to_mail)
 {
-	struct al5_queue *queue =
-		&user->queues[mail_to_queue(al5_mail_get_uid(mail))];
+	struct al5_mail *mails[SUBMIT_BATCH_MAX];
+	struct al5_ring *ring = READ_ONCE(user->submit_ring);
+	size_t capacity = al5_mcu_submit_capacity(user->mcu);
+	/* built but left for the next batch, it's the first record then */
+	struct al5_mail *next = NULL;
+	size_t batch_size, size;
+	int nb_sent = 0;
+	int nb_mails;
+	void *record;
+	int err;
+
+	if (!ring)
+		return -EPERM;
+
+	record = kmalloc(ring->record_size, GFP_KERNEL);
+	if (!record)
+		return -ENOMEM;
+
+	err = mutex_lock_killable(&user->locks[AL5_USER_XCODE]);
+	if (err == -EINTR)
+		goto free_record;
+
+	if (!al5_chan_is_created(user)) {
+		err = -EPERM;
+		goto unlock;
+	}
+
+	do {
+		nb_mails = 0;
+		batch_size = 0;
+		while (nb_mails < SUBMIT_BATCH_MAX) {
+			if (!next) {
+				if (!al5_ring_read(ring, nb_mails, record))
+					break;
+				next = to_mail(user, record);
+				if (IS_ERR_OR_NULL(next)) {
+					err = next ? PTR_ERR(next) : -ENOMEM;
+					next = NULL;
+					break;
+				}
+			}
+			size = al5_mailbox_mail_size(next);
+			if (nb_mails && batch_size + size > capacity)
+				break;
+			batch_size += size;
+			mails[nb_mails++] = next;
+			next = NULL;
+		}
+
+		if (nb_mails) {
+			int send_err = al5_check_and_send_batch(user, mails,
+								nb_mails);
+			if (send_err) {
+				err = send_err;
+				break;
+			}
+			al5_ring_consume(ring, nb_mails);
+			nb_sent += nb_mails;
+		}
+	} while (!err && (next || nb_mails == SUBMIT_BATCH_MAX));
+
+	al5_free_mail(next);
+
+	/* the wrong record is first now, it is reported on the next drain */
+	if (err == -EINVAL && !nb_sent)
+		al5_ring_consume(ring, 1);
 
-	al5_queue_push(queue, mail);
+unlock:
+	mutex_unlock(&user->locks[AL5_USER_XCODE]);
+free_record:
+	kfree(record);
+	return nb_sent ? nb_sent : err;
 }
+EXPORT_SYMBOL_GPL(al5_user_drain_submit_ring);
 
 static void user_queues_unlock(struct al5_user *user)
 {
@@ -93,6 +406,76 @@ static void user_queues_lock(struct al5_user *user)
 	al5_queue_lock(&user->queues[AL5_USER_MAIL_REC]);
 }
 
+/*
+ * Waits for the answer to a command, the mcu is stuck if it doesn't come.
+ * The hang is reported to the codec, which restarts the mcu if
+ * auto_recovery is set: every user loses its channel then, not only this
+ * one. An answer lost with a restart that happened since the command was
+ * sent is not a new hang.
+ */
+int al5_user_pop_answer(struct al5_user *user, int queue_id,
+			struct al5_mail **mail)
+{
+	int err = al5_queue_pop_timeout(mail, &user->queues[queue_id]);
+
+	if (err != -EINVAL || al5_user_is_reset(user))
+		return err;
+
+	if (al5_mcu_generation(user->mcu) != user->mcu_generation)
+		return -ECONNRESET;
+
+	dev_err(user->device, "Mcu didn't answer user %d\n", user->uid);
+	al5_mcu_report_hang(user->mcu);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_user_pop_answer);
+
+/* The channel died with the mcu, wake up everything waiting for it */
+void al5_user_reset(struct al5_user *user)
+{
+	int i;
+
+	WRITE_ONCE(user->mcu_reset, true);
+	for (i = 0; i < AL5_USER_MAIL_NUMBER; ++i)
+		al5_queue_unlock(&user->queues[i]);
+}
+EXPORT_SYMBOL_GPL(al5_user_reset);
+
+bool al5_user_is_reset(struct al5_user *user)
+{
+	return READ_ONCE(user->mcu_reset);
+}
+EXPORT_SYMBOL_GPL(al5_user_is_reset);
+
+/* Never waits, -EAGAIN if there is no debug mail */
+int al5_user_get_debug_mail(struct al5_user *user, struct al5_debug_mail *msg)
+{
+	struct al5_mail *mail;
+	int err = 0;
+
+	if (mutex_lock_interruptible(&user->locks[AL5_USER_DEBUG]))
+		return -EINTR;
+
+	mail = al5_queue_try_pop(&user->queues[AL5_USER_MAIL_DEBUG]);
+	if (!mail) {
+		err = -EAGAIN;
+		goto unlock;
+	}
+
+	msg->msg_uid = al5_mail_get_uid(mail);
+	msg->dropped = atomic_xchg(&user->debug_dropped, 0);
+	msg->size = al5_mail_get_size(mail);
+	memcpy(msg->body, al5_mail_get_body(mail),
+	       min_t(u32, msg->size, sizeof(msg->body)));
+	al5_free_mail(mail);
+
+unlock:
+	mutex_unlock(&user->locks[AL5_USER_DEBUG]);
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_user_get_debug_mail);
+
 void al5_user_remove_residual_messages(struct al5_user *user)
 {
 	int queue_id;
@@ -126,8 +509,11 @@ void al5_user_init(struct al5_user *user, int uid,
 	user->chan_uid = BAD_CHAN;
 	user->checkpoint = NO_CHECKPOINT;
 	user->device = device;
+	spin_lock_init(&user->status_ring_lock);
 	al5_bufpool_init(&user->int_buffers);
 	al5_bufpool_init(&user->rec_buffers);
+	al5_attach_cache_init(&user->attach_cache, device);
+	al5_buffer_table_init(&user->buffer_table, device);
 }
 EXPORT_SYMBOL_GPL(al5_user_init);
 
@@ -169,11 +555,10 @@ int al5_user_destroy_channel(struct al5_user *user, int quiet)
 		if (err)
 			goto unlock_mutexes;
 
-		mail = al5_queue_pop(&user->queues[AL5_USER_MAIL_DESTROY]);
-		if (mail == NULL) {
-			err = -EINTR;
+		/* a destroy that isn't answered restarts the mcu, see above */
+		err = al5_user_pop_answer(user, AL5_USER_MAIL_DESTROY, &mail);
+		if (err)
 			goto unlock_mutexes;
-		}
 
 		al5_free_mail(mail);
 	}
@@ -19,15 +19,32 @@
 
 #include "mcu_interface_private.h"
 #include "mcu_utils.h"
+#include "al_mail_private.h"
 
 #include <linux/printk.h>
+#include <linux/moduleparam.h>
+#include <linux/jiffies.h>
+#include <linux/sched.h>
+
+static unsigned int mailbox_head_watermark;
+module_param(mailbox_head_watermark, uint, 0644);
+MODULE_PARM_DESC(mailbox_head_watermark,
+		 "Bytes read from the status mailbox before giving its head back to the mcu during a drain (0: only at the end)");
+
+static unsigned int submit_queue_depth = 64;
+module_param(submit_queue_depth, uint, 0644);
+MODULE_PARM_DESC(submit_queue_depth,
+		 "Mails kept by the driver while the command mailbox is full");
+
+/* without an interrupt from the mcu, a blocked sender flushes by itself */
+#define SUBMIT_RETRY_MS 10
 
 int al5_mcu_interface_create(struct mcu_mailbox_interface **mcu,
 			     struct device *device,
 			     struct mcu_mailbox_config *config,
 			     void *mcu_interrupt_register)
 {
-	*mcu = devm_kmalloc(device, sizeof(*mcu), GFP_KERNEL);
+	*mcu = devm_kmalloc(device, sizeof(**mcu), GFP_KERNEL);
 	if (!*mcu)
 		return -ENOMEM;
 
@@ -47,6 +64,12 @@ int al5_mcu_interface_create(struct mcu_mailbox_interface **mcu,
 			 config->status_size);
 	spin_lock_init(&(*mcu)->read_lock);
 	spin_lock_init(&(*mcu)->write_lock);
+	INIT_LIST_HEAD(&(*mcu)->pending);
+	(*mcu)->pending_nb = 0;
+	init_waitqueue_head(&(*mcu)->pending_wait);
+	(*mcu)->hang_handler = NULL;
+	(*mcu)->restarting = false;
+	(*mcu)->generation = 0;
 	(*mcu)->interrupt_register = mcu_interrupt_register;
 	(*mcu)->dev = device;
 
@@ -57,6 +80,12 @@ EXPORT_SYMBOL_GPL(al5_mcu_interface_create);
 void al5_mcu_interface_destroy(struct mcu_mailbox_interface *mcu,
 			       struct device *device)
 {
+	struct al5_mail *mail, *next;
+
+	list_for_each_entry_safe(mail, next, &mcu->pending, list) {
+		list_del(&mail->list);
+		al5_free_mail(mail);
+	}
 	devm_kfree(device, mcu->mcu_to_cpu);
 	devm_kfree(device, mcu->cpu_to_mcu);
 	devm_kfree(device, mcu);
@@ -65,32 +94,194 @@ EXPORT_SYMBOL_GPL(al5_mcu_interface_destroy);
 
 /* These functions call mailbox methods */
 
-int al5_mcu_send(struct mcu_mailbox_interface *mcu, struct al5_mail *mail)
+static bool pending_has_room(struct mcu_mailbox_interface *mcu, int nb_mails)
 {
-	int error;
+	int pending_nb = READ_ONCE(mcu->pending_nb);
+
+	return pending_nb == 0 ||
+	       pending_nb + nb_mails <= READ_ONCE(submit_queue_depth);
+}
+
+/* Called with write_lock held, returns the number of mails sent */
+static int flush_pending(struct mcu_mailbox_interface *mcu)
+{
+	struct al5_mail *mail, *next;
+	int nb_sent = 0;
+
+	list_for_each_entry_safe(mail, next, &mcu->pending, list) {
+		if (al5_mailbox_write(mcu->cpu_to_mcu, mail))
+			break;
+		list_del(&mail->list);
+		al5_free_mail(mail);
+		++nb_sent;
+	}
+	mcu->pending_nb -= nb_sent;
+
+	if (nb_sent)
+		wake_up_interruptible(&mcu->pending_wait);
+
+	return nb_sent;
+}
+
+/*
+ * Write as many of the mails as there is room for in the mailbox if
+ * nothing is waiting before them, and park the others in the submission
+ * queue. A batch too big for the mailbox thus goes out in several parts.
+ * Returns -EAGAIN, without doing anything with the mails, if the
+ * submission queue is full and -ECONNRESET if the mcu is restarting.
+ * *nb_written tells how many of the mails were written, *signal if
+ * anything was written at all.
+ */
+static int submit_or_park(struct mcu_mailbox_interface *mcu,
+			  struct al5_mail **mails, int nb_mails,
+			  int *nb_written, bool *signal)
+{
+	int nb_flushed;
+	int i;
+
+	*nb_written = 0;
+	*signal = false;
 
 	spin_lock(&mcu->write_lock);
-	error = al5_mailbox_write(mcu->cpu_to_mcu, mail);
+	if (mcu->restarting) {
+		spin_unlock(&mcu->write_lock);
+		return -ECONNRESET;
+	}
+
+	nb_flushed = flush_pending(mcu);
+	if (!pending_has_room(mcu, nb_mails)) {
+		spin_unlock(&mcu->write_lock);
+		*signal = nb_flushed > 0;
+		return -EAGAIN;
+	}
+
+	if (list_empty(&mcu->pending))
+		*nb_written = al5_mailbox_write_batch(mcu->cpu_to_mcu, mails,
+						      nb_mails);
+	for (i = *nb_written; i < nb_mails; ++i)
+		list_add_tail(&mails[i]->list, &mcu->pending);
+	mcu->pending_nb += nb_mails - *nb_written;
 	spin_unlock(&mcu->write_lock);
 
-	if (error)
+	*signal = nb_flushed > 0 || *nb_written > 0;
+
+	return 0;
+}
+
+/*
+ * Send the mails to the mcu, keeping them in order. Mails that don't fit
+ * in the mailbox are kept until there is room for them again.
+ * When the submission queue is full too, wait for it unless nonblock is set.
+ * The mails are always consumed.
+ */
+int al5_mcu_submit(struct mcu_mailbox_interface *mcu,
+		   struct al5_mail **mails, int nb_mails, bool nonblock)
+{
+	int nb_written = 0;
+	bool signal;
+	long err = 0;
+	int i;
+
+	/* it would stay at the head of the submission queue forever */
+	for (i = 0; i < nb_mails; ++i)
+		if (!al5_mailbox_can_hold(mcu->cpu_to_mcu, mails[i]))
+			err = -EINVAL;
+	if (err)
+		goto free;
+
+	for (;;) {
+		err = submit_or_park(mcu, mails, nb_mails, &nb_written,
+				     &signal);
+		if (signal)
+			al5_signal_mcu(mcu);
+		if (err != -EAGAIN || nonblock)
+			break;
+
+		err = wait_event_interruptible_timeout(mcu->pending_wait,
+				pending_has_room(mcu, nb_mails),
+				msecs_to_jiffies(SUBMIT_RETRY_MS));
+		if (err < 0)
+			break;
+	}
+
+	if (err == -EAGAIN)
 		dev_warn_ratelimited(mcu->dev, "mailbox is full, retry");
 
-	return error;
+free:
+	/* the parked mails are freed once written */
+	if (!err)
+		nb_mails = nb_written;
+	for (i = 0; i < nb_mails; ++i)
+		al5_free_mail(mails[i]);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(al5_mcu_submit);
+
+/* Bytes of mails that can be written with a single doorbell at best */
+size_t al5_mcu_submit_capacity(struct mcu_mailbox_interface *mcu)
+{
+	return al5_mailbox_capacity(mcu->cpu_to_mcu);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_submit_capacity);
+
+/*
+ * The init mail is the first one a started mcu must get: it is written
+ * before the other senders are let in again after a restart.
+ */
+int al5_mcu_send_init(struct mcu_mailbox_interface *mcu,
+		      struct al5_mail *mail)
+{
+	int err;
+
+	spin_lock(&mcu->write_lock);
+	err = al5_mailbox_write(mcu->cpu_to_mcu, mail);
+	mcu->restarting = false;
+	spin_unlock(&mcu->write_lock);
+
+	if (!err)
+		al5_signal_mcu(mcu);
+	al5_free_mail(mail);
+
+	return err;
 }
-EXPORT_SYMBOL_GPL(al5_mcu_send);
+EXPORT_SYMBOL_GPL(al5_mcu_send_init);
 
-struct al5_mail *al5_mcu_recv(struct mcu_mailbox_interface *mcu)
+/* Move as many parked mails as possible to the mailbox */
+void al5_mcu_flush(struct mcu_mailbox_interface *mcu)
 {
-	struct al5_mail *mail;
+	int nb_sent;
+
+	if (!READ_ONCE(mcu->pending_nb))
+		return;
+
+	spin_lock(&mcu->write_lock);
+	nb_sent = flush_pending(mcu);
+	spin_unlock(&mcu->write_lock);
+
+	if (nb_sent)
+		al5_signal_mcu(mcu);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_flush);
+
+/*
+ * Drain the mails present in the mailbox, at most budget of them.
+ * handle is called with the read_lock held.
+ */
+int al5_mcu_recv_batch(struct mcu_mailbox_interface *mcu, int budget,
+		       al5_mail_handler handle, void *data)
+{
+	int nb_mails;
 
 	spin_lock(&mcu->read_lock);
-	mail = al5_mailbox_read(mcu->mcu_to_cpu);
+	nb_mails = al5_mailbox_read_batch(mcu->mcu_to_cpu, budget,
+					  READ_ONCE(mailbox_head_watermark),
+					  handle, data);
 	spin_unlock(&mcu->read_lock);
 
-	return mail;
+	return nb_mails;
 }
-EXPORT_SYMBOL_GPL(al5_mcu_recv);
+EXPORT_SYMBOL_GPL(al5_mcu_recv_batch);
 
 int al5_mcu_is_empty(struct mcu_mailbox_interface *mcu)
 {
@@ -113,6 +304,70 @@ void al5_signal_mcu(struct mcu_mailbox_interface *mcu)
 }
 EXPORT_SYMBOL_GPL(al5_signal_mcu);
 
+/*
+ * Refuse new mails until the init mail of the restarted mcu is sent.
+ * Answers that were awaited before this will never come.
+ */
+void al5_mcu_begin_restart(struct mcu_mailbox_interface *mcu)
+{
+	spin_lock(&mcu->write_lock);
+	mcu->restarting = true;
+	WRITE_ONCE(mcu->generation, mcu->generation + 1);
+	spin_unlock(&mcu->write_lock);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_begin_restart);
+
+u32 al5_mcu_generation(struct mcu_mailbox_interface *mcu)
+{
+	return READ_ONCE(mcu->generation);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_generation);
+
+/*
+ * Forget everything exchanged with the mcu, which must be stopped.
+ * Parked mails are dropped and their senders woken up.
+ */
+void al5_mcu_reset(struct mcu_mailbox_interface *mcu)
+{
+	struct al5_mail *mail, *next;
+	LIST_HEAD(dropped);
+
+	spin_lock(&mcu->read_lock);
+	al5_mailbox_reset(mcu->mcu_to_cpu);
+	spin_unlock(&mcu->read_lock);
+
+	spin_lock(&mcu->write_lock);
+	al5_mailbox_reset(mcu->cpu_to_mcu);
+	list_splice_init(&mcu->pending, &dropped);
+	mcu->pending_nb = 0;
+	spin_unlock(&mcu->write_lock);
+
+	wake_up_interruptible(&mcu->pending_wait);
+
+	list_for_each_entry_safe(mail, next, &dropped, list) {
+		list_del(&mail->list);
+		al5_free_mail(mail);
+	}
+}
+EXPORT_SYMBOL_GPL(al5_mcu_reset);
+
+void al5_mcu_set_hang_handler(struct mcu_mailbox_interface *mcu,
+			      void (*handler)(void *data), void *data)
+{
+	mcu->hang_data = data;
+	WRITE_ONCE(mcu->hang_handler, handler);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_set_hang_handler);
+
+void al5_mcu_report_hang(struct mcu_mailbox_interface *mcu)
+{
+	void (*handler)(void *data) = READ_ONCE(mcu->hang_handler);
+
+	if (handler)
+		handler(mcu->hang_data);
+}
+EXPORT_SYMBOL_GPL(al5_mcu_report_hang);
+
 const u32 mcu_cache_offset = 0x80000000;
 
 u32 al5_mcu_get_virtual_address(u32 physicalAddress)
@@ -16,7 +16,11 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "mcu_utils.h"
-/* only 32 bits access are available on the apb */
+/*
+ * only 32 bits access are available on the apb.
+ * The accesses are relaxed, the caller orders the whole copy with a barrier
+ * before publishing it.
+ */
 int memcpy_toio_32(void *pdst, const void *psrc, int size)
 {
 	const __u32 *src = psrc;
@@ -24,7 +28,7 @@ int memcpy_toio_32(void *pdst, const void *psrc, int size)
 	int i;
 
 	for (i = 0; i < size / 4; ++i)
-		iowrite32(src[i], dst + i);
+		writel_relaxed(src[i], dst + i);
 	return 0;
 }
 
@@ -35,7 +39,7 @@ int memcpy_fromio_32(void *pdst, void *psrc, int size)
 	int i;
 
 	for (i = 0; i < size / 4; ++i)
-		dst[i] = ioread32(src + i);
+		dst[i] = readl_relaxed(src + i);
 	return 0;
 }
 
@@ -26,9 +26,12 @@ struct al5_dma_buffer {
 	u32 size;
 	dma_addr_t dma_handle;
 	void *cpu_handle;
+	u32 flags;
 };
 
 struct al5_dma_buffer *al5_alloc_dma(struct device *dev, size_t size);
+struct al5_dma_buffer *al5_alloc_dma_flags(struct device *dev, size_t size,
+					   u32 flags);
 void al5_free_dma(struct device *dev, struct al5_dma_buffer *buf);
 
 #endif /* _AL_ALLOC_H_ */
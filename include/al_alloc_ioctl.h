@@ -17,6 +17,13 @@
 
 #include <linux/device.h>
 
-int al5_ioctl_get_dma_fd(struct device *dev, unsigned long arg);
-int al5_ioctl_get_dmabuf_dma_addr(struct device *dev, unsigned long arg);
+#include "al_dma_cache.h"
+#include "al_attach_cache.h"
+
+int al5_ioctl_get_dma_fd(struct device *dev, struct al5_dma_cache *cache,
+			 unsigned long arg);
+int al5_ioctl_get_dma_fd_ext(struct device *dev, struct al5_dma_cache *cache,
+			     u32 flags, unsigned long arg);
+int al5_ioctl_get_dmabuf_dma_addr(struct al5_attach_cache *cache,
+				   unsigned long arg);
 
@@ -0,0 +1,50 @@
+/*
+ * al_attach_cache.h attachments of the dma-bufs given to the mcu, kept
+ * between lookups
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AL_ATTACH_CACHE_H_
+#define _AL_ATTACH_CACHE_H_
+
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+#include "al_dmabuf.h"
+
+/*
+ * The foreign dma-bufs looked up most recently stay attached and mapped,
+ * the least recently used one is dropped past a few of them. An entry holds
+ * a reference on its dma-buf, so the dma_buf pointer it is keyed by can't be
+ * reused while it is cached.
+ */
+struct al5_attach_cache {
+	struct device *dev;
+
+	/* protects everything below */
+	struct mutex lock;
+	/* oldest first */
+	struct list_head entries;
+	unsigned int nb_entries;
+};
+
+void al5_attach_cache_init(struct al5_attach_cache *cache, struct device *dev);
+void al5_attach_cache_flush(struct al5_attach_cache *cache);
+int al5_attach_cache_get_info(struct al5_attach_cache *cache, u32 fd,
+			      struct al5_buffer_info *info);
+
+#endif /* _AL_ATTACH_CACHE_H_ */
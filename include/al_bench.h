@@ -0,0 +1,31 @@
+/*
+ * al_bench.h benchmarks of the driver primitives, run from debugfs
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AL_BENCH_H_
+#define _AL_BENCH_H_
+
+#include <linux/types.h>
+
+struct seq_file;
+struct device;
+
+int al5_bench_copy_show(struct seq_file *m, void *unused);
+/* Only the allocation types in flags are run, coherent always is */
+int al5_bench_fill(struct seq_file *m, struct device *dev, u32 flags);
+
+#endif /* _AL_BENCH_H_ */
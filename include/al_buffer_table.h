@@ -0,0 +1,63 @@
+/*
+ * al_buffer_table.h dma-bufs registered once by a user and then referred to
+ * by index
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AL_BUFFER_TABLE_H_
+#define _AL_BUFFER_TABLE_H_
+
+#include <linux/device.h>
+#include <linux/mutex.h>
+
+#include "al_ioctl.h"
+
+struct dma_buf;
+struct dma_buf_attachment;
+struct sg_table;
+
+struct al5_fixed_buffer {
+	struct dma_buf *dbuf;
+	/* NULL for the buffers allocated by the driver for the device */
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+	u32 bus_address;
+	u32 mcu_address;
+	u32 size;
+};
+
+/*
+ * The buffers stay pinned and mapped from their registration until the
+ * table is unregistered, their addresses are resolved once.
+ */
+struct al5_buffer_table {
+	struct device *dev;
+
+	/* protects everything below */
+	struct mutex lock;
+	struct al5_fixed_buffer *buffers;
+	u32 nb_buffers;
+};
+
+void al5_buffer_table_init(struct al5_buffer_table *table, struct device *dev);
+int al5_buffer_table_register(struct al5_buffer_table *table,
+			      struct al5_registered_buffer *buffers,
+			      u32 nb_buffers);
+int al5_buffer_table_unregister(struct al5_buffer_table *table);
+int al5_buffer_table_get(struct al5_buffer_table *table, u32 index,
+			 u32 *bus_address, u32 *mcu_address, u32 *size);
+
+#endif /* _AL_BUFFER_TABLE_H_ */
@@ -27,10 +27,12 @@
 #include <linux/firmware.h>
 #include <linux/platform_device.h>
 #include <linux/interrupt.h>
+#include <linux/completion.h>
 
 #include "al_group.h"
 #include "mcu_interface.h"
 #include "al_alloc.h"
+#include "al_dma_cache.h"
 #include "al_user.h"
 #include "al_vcu.h"
 #include "al_traces.h"
@@ -89,6 +91,7 @@ struct al5_codec_desc {
 	/* Base addr for regs */
 	void __iomem *regs;
 	unsigned long regs_size;
+	int irq;
 
 	/* cache */
 	struct al5_dma_buffer *icache, *suballoc_buf;
@@ -96,11 +99,42 @@ struct al5_codec_desc {
 
 	struct al5_group users_group;
 	int minor;
+
+	/* firmware loading and mcu start, done asynchronously */
+	const char *fw_file;
+	const char *bl_fw_file;
+	struct completion mcu_ready;
+	int mcu_err;
+	/* kept to restart the mcu */
+	const struct firmware *fw;
+	const struct firmware *bl_fw;
+	struct work_struct recovery_work;
+	atomic_t recoveries;
+
+	/* channels destroyed after their file was closed */
+	struct workqueue_struct *teardown_wq;
+	atomic_t teardowns_pending;
+	/* set once the device is going away */
+	bool removing;
+
+	/* buffers of GET_DMA_FD, NULL if it couldn't be created */
+	struct al5_dma_cache *dma_cache;
+	/* AL5_DMA_FLAG_* the buffers of GET_DMA_FD_EXT can be allocated with */
+	u32 dma_flags;
+
+	/* debugfs directory of the device, may be NULL */
+	struct dentry *debugfs;
+
+	/* busy polls that got a status before giving up */
+	atomic_t busy_poll_hits;
+	atomic_t busy_poll_misses;
 };
 
 struct al5_filp_data {
 	struct al5_codec_desc *codec;
 	struct al5_user *user;
+	/* destroys the channel of the user once the file is closed */
+	struct work_struct teardown;
 };
 
 int al5_codec_set_up(struct al5_codec_desc *codec,
@@ -109,11 +143,16 @@ int al5_codec_set_up(struct al5_codec_desc *codec,
 
 void al5_codec_tear_down(struct al5_codec_desc *codec);
 
-int al5_codec_set_firmware(struct al5_codec_desc *codec, char *fw_file,
-			   char *bl_fw_file);
+void al5_codec_recover(struct al5_codec_desc *codec);
+int al5_codec_set_firmware(struct al5_codec_desc *codec, const char *fw_file,
+			   const char *bl_fw_file);
 
 int al5_codec_open(struct inode *inode, struct file *filp);
 int al5_codec_release(struct inode *inode, struct file *filp);
+unsigned int al5_codec_poll(struct file *filp, poll_table *wait);
+int al5_codec_mmap(struct file *filp, struct vm_area_struct *vma);
+int al5_codec_set_busy_poll(struct al5_user *user, unsigned long arg);
+void al5_codec_busy_poll(struct al5_codec_desc *codec, struct al5_user *user);
 
 long al5_codec_compat_ioctl(struct file *file, unsigned int cmd,
 			    unsigned long arg);
@@ -0,0 +1,69 @@
+/*
+ * al_dma_cache.h recycling of the dma buffers given to userspace
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AL_DMA_CACHE_H_
+#define _AL_DMA_CACHE_H_
+
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
+#include <linux/shrinker.h>
+
+#include "al_alloc.h"
+
+struct seq_file;
+struct pid;
+
+/*
+ * Released buffers are kept in per size free lists, the least recently
+ * released ones are freed first to stay within the byte budget or when
+ * memory is short. Buffers in use hold a reference on the cache so that it
+ * can outlive its device.
+ */
+struct al5_dma_cache {
+	struct device *dev;
+	struct kref ref;
+	struct shrinker shrinker;
+
+	/* protects everything below */
+	struct mutex lock;
+	struct list_head buckets;
+	struct list_head lru;
+	size_t cached_bytes;
+	unsigned long nb_cached;
+	bool dead;
+
+	atomic_t hits;
+	atomic_t misses;
+	atomic_t evictions;
+	atomic_t shrunk;
+};
+
+struct al5_dma_cache *al5_dma_cache_create(struct device *dev);
+void al5_dma_cache_destroy(struct al5_dma_cache *cache);
+
+struct al5_dma_buffer *al5_dma_cache_alloc(struct al5_dma_cache *cache,
+					   size_t size, u32 flags);
+void al5_dma_cache_free(struct al5_dma_cache *cache,
+			struct al5_dma_buffer *buffer, struct pid *owner);
+
+int al5_dma_cache_show(struct seq_file *m, void *unused);
+
+#endif /* _AL_DMA_CACHE_H_ */
@@ -14,9 +14,14 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef _AL_DMABUF_H_
+#define _AL_DMABUF_H_
 
 #include <linux/device.h>
 #include "al_alloc.h"
+#include "al_dma_cache.h"
+
+struct dma_buf;
 
 struct al5_buffer_info {
 	u32 bus_address;
@@ -28,7 +33,12 @@ void *al5_dmabuf_wrap(struct device *dev, unsigned long size,
 int al5_create_dmabuf_fd(struct device *dev, unsigned long size,
 			 struct al5_dma_buffer *buffer);
 
-int al5_allocate_dmabuf(struct device *dev, int size, u32 *fd);
+int al5_allocate_dmabuf(struct device *dev, struct al5_dma_cache *cache,
+			int size, u32 flags, u32 *fd);
+bool al5_dmabuf_own_info(struct dma_buf *dbuf, struct device *dev,
+			 struct al5_buffer_info *info);
 int al5_dmabuf_get_address(struct device *dev, u32 fd, u32 *bus_address);
 int al5_get_dmabuf_info(struct device *dev, u32 fd,
 			struct al5_buffer_info *info);
+
+#endif /* _AL_DMABUF_H_ */
@@ -19,21 +19,60 @@
 #define __AL_GROUP__
 
 #include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/idr.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/kfifo.h>
+#include <linux/mutex.h>
 
 #include "mcu_interface.h"
 #include "al_user.h"
 
+/* chan_uid are sent on a byte by the mcu */
+#define AL5_CHAN_UID_NUMBER 256
+
+/* longest substring the mcu traces can be filtered on, nul included */
+#define AL5_TRACE_FILTER_SIZE 32
+
+/*
+ * users and chans are read under rcu by the irq thread, lock serializes
+ * their updates. An unbound user can be freed once al5_group_unbind_user()
+ * returned.
+ */
 struct al5_group {
 	struct mcu_mailbox_interface *mcu;
 	spinlock_t lock;
 
-	int max_users_nb;
-	struct al5_user **users;
+	/* users get a uid below max_users_nb, it can be changed at any time */
+	u32 max_users_nb;
+	struct idr users;
+	/* user owning each channel, set when the channel creation is acked */
+	struct al5_user __rcu *chans[AL5_CHAN_UID_NUMBER];
 	struct device *device;
+
+	/* mails delivered per drain, adapted to the backlog */
+	int drain_budget;
+	/* drains again when the budget didn't empty the mailbox */
+	struct work_struct drain_work;
+	atomic_t drains;
+	atomic_t drained_mails;
+	atomic_t budget_exhausted;
+	atomic_t rescheduled;
+
+	/* mcu traces, written by the mailbox drain and read from debugfs */
+	DECLARE_KFIFO_PTR(traces, char);
+	struct mutex traces_read_lock;
+	atomic_t traces_dropped;
+	/* if not empty, only the traces containing it are kept */
+	char trace_filter[AL5_TRACE_FILTER_SIZE];
+	spinlock_t trace_filter_lock;
 };
 
-void al5_group_init(struct al5_group *group, struct mcu_mailbox_interface *mcu,
-		    int max_users_nb, struct device *device);
+struct seq_file;
+
+int al5_group_init(struct al5_group *group, struct mcu_mailbox_interface *mcu,
+		   int max_users_nb, struct device *device);
 void al5_group_deinit(struct al5_group *group);
 
 int al5_group_bind_user(struct al5_group *group, struct al5_user *user);
@@ -43,6 +82,12 @@ struct al5_user *al5_group_user_from_uid(struct al5_group *group, int user_uid);
 struct al5_user *al5_group_user_from_chan_uid(struct al5_group *group,
 					      int chan_uid);
 
+void al5_group_reset_users(struct al5_group *group);
 void al5_group_read_mails(struct al5_group *group);
+int al5_group_drain_show(struct seq_file *m, void *unused);
+ssize_t al5_group_read_traces(struct al5_group *group, char __user *buf,
+			      size_t count);
+void al5_group_set_trace_filter(struct al5_group *group, const char *filter);
+int al5_group_set_max_users(struct al5_group *group, u32 max_users_nb);
 
 #endif
@@ -21,6 +21,19 @@
 
 #define GET_DMA_FD        _IOWR('q', 13, struct al5_dma_info)
 #define GET_DMA_PHY       _IOWR('q', 18, struct al5_dma_info)
+#define AL_MCU_SETUP_STATUS_RING _IOWR('q', 30, struct al5_ring_info)
+#define AL_MCU_SETUP_SUBMIT_RING _IOWR('q', 31, struct al5_ring_info)
+#define AL_MCU_SUBMIT_RING_DOORBELL _IO('q', 32)
+/* microseconds WAIT_FOR_STATUS spins on the mailbox before sleeping, 0: off */
+#define AL_MCU_SET_BUSY_POLL _IOW('q', 33, __u32)
+#define AL_MCU_GET_DEBUG_MAIL _IOR('q', 34, struct al5_debug_mail)
+#define GET_DMA_FD_EXT    _IOWR('q', 35, struct al5_dma_info_ext)
+#define AL_MCU_REGISTER_BUFFERS _IOW('q', 36, struct al5_buffer_registration)
+#define AL_MCU_UNREGISTER_BUFFERS _IO('q', 37)
+
+/* mmap offsets of the rings on the device file */
+#define AL5_STATUS_RING_OFFSET 0x0
+#define AL5_SUBMIT_RING_OFFSET 0x100000
 
 #include <linux/types.h>
 
@@ -30,4 +43,88 @@ struct al5_dma_info {
 	__u32 phy_addr;
 };
 
+/*
+ * Cached buffers are mapped cacheable by mmap, the cpu accesses must be
+ * bracketed by DMA_BUF_IOCTL_SYNC. They are physically contiguous pages,
+ * so their size is limited by the page allocator, and they are refused
+ * with -EINVAL on a device that has dedicated memory.
+ * Write combined buffers suit the ones the cpu only fills sequentially for
+ * the device to read, they need no sync. The two flags are exclusive.
+ */
+#define AL5_DMA_FLAG_CACHED (1 << 0)
+#define AL5_DMA_FLAG_WRITE_COMBINE (1 << 1)
+#define AL5_DMA_FLAGS (AL5_DMA_FLAG_CACHED | AL5_DMA_FLAG_WRITE_COMBINE)
+
+struct al5_dma_info_ext {
+	__u32 fd;		/* out */
+	__u32 size;
+	__u32 phy_addr;		/* out */
+	__u32 flags;		/* AL5_DMA_FLAG_* */
+};
+
+/*
+ * Buffer i of a registration is buffers[i], AL_MCU_PUT_FIXED_STREAM_BUFFER
+ * refers to it by i. Their addresses are written back, so that the encode
+ * and decode params can use them without GET_DMA_PHY. Those params are
+ * opaque to the driver, it doesn't check the addresses in them.
+ * The buffers stay pinned until AL_MCU_UNREGISTER_BUFFERS, which is refused
+ * while the channel exists, or until the file is closed.
+ * reserved must be 0.
+ */
+#define AL5_MAX_REGISTERED_BUFFERS 256
+
+struct al5_registered_buffer {
+	__u32 fd;		/* in */
+	__u32 size;		/* out */
+	__u32 phy_addr;		/* out */
+	__u32 mcu_addr;		/* out */
+};
+
+struct al5_buffer_registration {
+	__u64 buffers;		/* struct al5_registered_buffer[nb_buffers] */
+	__u32 nb_buffers;
+	__u32 reserved;
+};
+
+/*
+ * A ring mapping starts with this header, followed by nb_records records.
+ * head and tail are free running counters, record i is at i % nb_records.
+ * The producer only writes tail and the consumer only writes head.
+ */
+struct al5_ring_header {
+	__u32 head;
+	__u32 reserved0[15];
+	__u32 tail;
+	__u32 reserved1[15];
+};
+
+struct al5_ring_info {
+	__u32 nb_records;	/* in, power of 2 */
+	__u32 record_size;	/* out */
+	__u64 mmap_offset;	/* out */
+	__u64 mmap_size;	/* out */
+};
+
+/*
+ * The records of a submission ring are the messages of the encode or decode
+ * ioctls, see al_enc_ioctl.h and al_dec_ioctl.h.
+ */
+
+/* record of the status ring, same layout as the status of WAIT_FOR_STATUS */
+struct al5_status_record {
+	__u32 size;
+	__u32 opaque[128];
+};
+
+/*
+ * mcu message that no other ioctl reports. Only the oldest ones are dropped
+ * when userspace doesn't read them, dropped counts them since the last read.
+ */
+struct al5_debug_mail {
+	__u32 msg_uid;
+	__u32 dropped;
+	__u32 size;		/* of the mail, body may be truncated */
+	__u32 body[128];
+};
+
 #endif /* _AL_IOCTL_H_ */
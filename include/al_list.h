@@ -19,17 +19,21 @@
 #ifndef __AL_LIST__
 #define __AL_LIST__
 
+#include <linux/list.h>
+
 #include "al_mailbox.h"
 
+/* FIFO of mails, linked through the mails themselves */
 struct al5_list {
-	struct al5_mail *mail;
-	struct al5_list *next;
+	struct list_head head;
+	unsigned int nb;
 };
 
-void al5_list_init(struct al5_list **l);
+void al5_list_init(struct al5_list *l);
 int al5_list_empty(const struct al5_list *l);
-void al5_list_push(struct al5_list **l, struct al5_mail *mail);
-struct al5_mail *al5_list_pop(struct al5_list **l);
-void al5_list_empty_and_destroy(struct al5_list **l);
+unsigned int al5_list_size(const struct al5_list *l);
+void al5_list_push(struct al5_list *l, struct al5_mail *mail);
+struct al5_mail *al5_list_pop(struct al5_list *l);
+void al5_list_empty_and_destroy(struct al5_list *l);
 
 #endif
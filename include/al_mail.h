@@ -24,6 +24,8 @@
 
 struct al5_mail;
 
+struct seq_file;
+
 struct al5_mail *al5_mail_create(u32 msg_uid, u32 size);
 void al5_mail_write(struct al5_mail *mail, void *content, u32 size);
 void al5_mail_write_word(struct al5_mail *mail, u32 word);
@@ -35,4 +37,10 @@ u32 al5_mail_get_word(struct al5_mail *mail, u32 word_offset);
 
 struct al5_mail *al5_mail_create_copy(struct al5_mail *mail);
 
+/* Mails are allocated from size class caches shared by all the devices */
+int al5_mail_caches_init(void);
+void al5_mail_caches_deinit(void);
+int al5_mail_caches_show(struct seq_file *m, void *unused);
+struct al5_mail *al5_mail_create_atomic(u32 msg_uid, u32 content_size);
+
 #endif /* _MCU_COMMON_H_ */
@@ -18,11 +18,18 @@
 #ifndef __AL_MAIL_PRIVATE__
 #define __AL_MAIL_PRIVATE__
 
+#include <linux/mempool.h>
+#include <linux/list.h>
+
 struct al5_mail {
 	u32 body_offset;
 	u16 msg_uid;
 	u16 body_size;
 	u8 *body;
+	/* pool the mail was taken from, NULL if it was kmalloc'ed */
+	mempool_t *pool;
+	/* link in the mcu submission queue or in a user queue */
+	struct list_head list;
 };
 
 #endif
@@ -23,6 +23,8 @@
 
 #include "al_mail.h"
 
+typedef void (*al5_mail_handler)(struct al5_mail *mail, void *data);
+
 struct mailbox {
 	size_t size; /* In bytes */
 	u8 *data;
@@ -32,7 +34,15 @@ struct mailbox {
 };
 
 void al5_mailbox_init(struct mailbox *box, void *base, size_t data_size);
+void al5_mailbox_reset(struct mailbox *box);
+size_t al5_mailbox_mail_size(struct al5_mail *mail);
+size_t al5_mailbox_capacity(struct mailbox *box);
+bool al5_mailbox_can_hold(struct mailbox *box, struct al5_mail *mail);
 int al5_mailbox_write(struct mailbox *box, struct al5_mail *mail);
+int al5_mailbox_write_batch(struct mailbox *box, struct al5_mail **mails,
+			    int nb_mails);
 struct al5_mail *al5_mailbox_read(struct mailbox *box);
+int al5_mailbox_read_batch(struct mailbox *box, int budget, size_t watermark,
+			   al5_mail_handler handle, void *data);
 
 #endif /* _MCU_MAILBOX_H_ */
@@ -0,0 +1,27 @@
+/*
+ * al_module.h init and exit of the allegro common module
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AL_MODULE_H_
+#define _AL_MODULE_H_
+
+struct dentry;
+
+/* "allegro" debugfs directory, NULL if debugfs isn't available */
+struct dentry *al5_debugfs_root(void);
+
+#endif /* _AL_MODULE_H_ */
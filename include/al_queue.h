@@ -22,6 +22,7 @@
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/spinlock.h>
+#include <linux/poll.h>
 
 #include "al_mailbox.h"
 #include "al_list.h"
@@ -30,16 +31,21 @@
 
 struct al5_queue {
 	wait_queue_head_t queue;
-	struct al5_list *list;
+	struct al5_list list;
 	spinlock_t lock;
 	int locked;
 };
 
 void al5_queue_init(struct al5_queue *q);
 struct al5_mail *al5_queue_pop(struct al5_queue *q);
+struct al5_mail *al5_queue_try_pop(struct al5_queue *q);
 int al5_queue_pop_timeout(struct al5_mail **mail, struct al5_queue *q);
 void al5_queue_push(struct al5_queue *q, struct al5_mail *mail);
+bool al5_queue_push_bounded(struct al5_queue *q, struct al5_mail *mail,
+			    unsigned int max_mails);
 void al5_queue_unlock(struct al5_queue *q);
 void al5_queue_lock(struct al5_queue *q);
+bool al5_queue_is_empty(struct al5_queue *q);
+bool al5_queue_poll(struct al5_queue *q, struct file *filp, poll_table *wait);
 
 #endif
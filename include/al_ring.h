@@ -0,0 +1,54 @@
+/*
+ * al_ring.h rings of fixed size records shared with userspace
+ *
+ * Copyright (C) 2016, Allegro DVT (www.allegrodvt.com)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AL_RING__
+#define __AL_RING__
+
+#include <linux/types.h>
+#include <linux/mm.h>
+
+#include "al_ioctl.h"
+
+#define AL5_RING_MAX_RECORDS 256
+
+/*
+ * The driver is either the producer or the consumer of a ring. It keeps its
+ * own copy of the index it owns, only the other one is read back from the
+ * shared memory.
+ */
+struct al5_ring {
+	struct al5_ring_header *header;
+	u8 *records;
+	u32 nb_records;
+	u32 record_size;
+	u32 head;
+	u32 tail;
+	size_t size;
+};
+
+int al5_ring_init(struct al5_ring *ring, u32 nb_records, u32 record_size);
+void al5_ring_deinit(struct al5_ring *ring);
+int al5_ring_mmap(struct al5_ring *ring, struct vm_area_struct *vma);
+bool al5_ring_is_empty(struct al5_ring *ring);
+bool al5_ring_is_full(struct al5_ring *ring);
+void *al5_ring_next_slot(struct al5_ring *ring);
+void al5_ring_produce(struct al5_ring *ring);
+bool al5_ring_read(struct al5_ring *ring, u32 offset, void *record);
+void al5_ring_consume(struct al5_ring *ring, u32 nb_records);
+
+#endif
@@ -27,6 +27,9 @@
 #include "al_queue.h"
 #include "mcu_interface.h"
 #include "al_buffers_pool.h"
+#include "al_ring.h"
+#include "al_attach_cache.h"
+#include "al_buffer_table.h"
 
 enum user_mail {
 	AL5_USER_MAIL_INIT,
@@ -70,6 +73,10 @@ struct al5_user {
 	int chan_uid;
 
 	int checkpoint;
+	/* the current ioctl was issued on a O_NONBLOCK file */
+	bool nonblock;
+	/* set with AL_MCU_SET_BUSY_POLL */
+	u32 busy_poll_us;
 
 	struct mcu_mailbox_interface *mcu;
 
@@ -79,14 +86,39 @@ struct al5_user {
 	struct device *device;
 	struct al5_buffers_pool int_buffers;
 	struct al5_buffers_pool rec_buffers;
+
+	/* statuses are delivered here instead of the STATUS queue if set */
+	struct al5_ring *status_ring;
+	spinlock_t status_ring_lock;
+	/* commands written by userspace, protected by the XCODE lock */
+	struct al5_ring *submit_ring;
+
+	/* the dma-bufs given by this user, attached for the device */
+	struct al5_attach_cache attach_cache;
+	/* the dma-bufs registered with AL_MCU_REGISTER_BUFFERS */
+	struct al5_buffer_table buffer_table;
+
+	/* debug mails dropped since userspace last read one */
+	atomic_t debug_dropped;
+
+	/* the mcu was restarted, the channel of the user is gone */
+	bool mcu_reset;
+	/* generation of the mcu the last command was sent to */
+	u32 mcu_generation;
 };
 
+/* Builds the mail of a submission record, ERR_PTR if the record is wrong */
+typedef struct al5_mail *(*al5_record_to_mail)(struct al5_user *user,
+					       void *record);
+
 void al5_user_init(struct al5_user *user, int uid,
 		   struct mcu_mailbox_interface *mcu, struct device *device);
 int al5_user_destroy_channel(struct al5_user *user, int quiet);
 void al5_user_remove_residual_messages(struct al5_user *user);
 
 int al5_check_and_send(struct al5_user *user, struct al5_mail *mail);
+int al5_check_and_send_batch(struct al5_user *user, struct al5_mail **mails,
+			     int nb_mails);
 
 int al5_chan_is_created(struct al5_user *user);
 
@@ -100,5 +132,22 @@ int al5_status_is_ready(struct al5_user *user, struct al5_mail **mail,
 			int my_uid);
 
 struct al5_mail *al5_user_get_mail(struct al5_user *user, u32 mail_uid);
+int al5_user_get_debug_mail(struct al5_user *user, struct al5_debug_mail *msg);
+int al5_user_pop_answer(struct al5_user *user, int queue_id,
+			struct al5_mail **mail);
+void al5_user_reset(struct al5_user *user);
+bool al5_user_is_reset(struct al5_user *user);
+
+int al5_user_setup_status_ring(struct al5_user *user,
+			       struct al5_ring_info *info);
+void al5_user_refill_status_ring(struct al5_user *user);
+bool al5_user_status_is_ready(struct al5_user *user);
+void al5_user_release_rings(struct al5_user *user);
+int al5_user_register_buffers(struct al5_user *user, unsigned long arg);
+int al5_user_unregister_buffers(struct al5_user *user);
+int al5_user_setup_submit_ring(struct al5_user *user,
+			       struct al5_ring_info *info, u32 record_size);
+int al5_user_drain_submit_ring(struct al5_user *user,
+			       al5_record_to_mail to_mail);
 
 #endif /* _AL_USER_H_ */
@@ -45,11 +45,24 @@ void al5_mcu_interface_destroy(struct mcu_mailbox_interface *mcu,
 
 int al5_mcu_is_empty(struct mcu_mailbox_interface *mcu);
 
-int al5_mcu_send(struct mcu_mailbox_interface *mcu, struct al5_mail *data);
-struct al5_mail *al5_mcu_recv(struct mcu_mailbox_interface *mcu);
+int al5_mcu_submit(struct mcu_mailbox_interface *mcu,
+		   struct al5_mail **mails, int nb_mails, bool nonblock);
+size_t al5_mcu_submit_capacity(struct mcu_mailbox_interface *mcu);
+int al5_mcu_send_init(struct mcu_mailbox_interface *mcu,
+		      struct al5_mail *mail);
+void al5_mcu_flush(struct mcu_mailbox_interface *mcu);
+int al5_mcu_recv_batch(struct mcu_mailbox_interface *mcu, int budget,
+		       al5_mail_handler handle, void *data);
 
 void al5_signal_mcu(struct mcu_mailbox_interface *mcu);
 
+void al5_mcu_begin_restart(struct mcu_mailbox_interface *mcu);
+void al5_mcu_reset(struct mcu_mailbox_interface *mcu);
+u32 al5_mcu_generation(struct mcu_mailbox_interface *mcu);
+void al5_mcu_set_hang_handler(struct mcu_mailbox_interface *mcu,
+			      void (*handler)(void *data), void *data);
+void al5_mcu_report_hang(struct mcu_mailbox_interface *mcu);
+
 u32 al5_mcu_get_virtual_address(u32 physicalAddress);
 
 #endif /* _MCU_INTERFACE_H_ */
@@ -19,6 +19,8 @@
 #define __MCU_INTERFACE_PRIVATE__
 
 #include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/wait.h>
 #include "mcu_interface.h"
 
 struct mcu_mailbox_interface {
@@ -28,6 +30,17 @@ struct mcu_mailbox_interface {
 	spinlock_t write_lock;
 	void *interrupt_register;
 	struct device *dev;
+	/* mails waiting for room in cpu_to_mcu, protected by write_lock */
+	struct list_head pending;
+	int pending_nb;
+	wait_queue_head_t pending_wait;
+	/* called when the mcu doesn't answer anymore */
+	void (*hang_handler)(void *data);
+	void *hang_data;
+	/* no mail is taken while the mcu restarts, protected by write_lock */
+	bool restarting;
+	/* bumped each time the mcu is restarted */
+	u32 generation;
 };
 
 #endif